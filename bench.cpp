@@ -0,0 +1,665 @@
+#include "ks.h"
+#include "kmp.h"
+#include "kb.h"
+#include "kh.h"
+#include "ksort.h"
+#include "ksearch.h"
+#include "ksparse.h"
+#include "kt.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Microbenchmarks for the ks, kmp, kb and kh hot paths, with standard library baselines.
+// Usage: bench [--quick] [--tsv] [filter]
+// Results are JSON lines ({"name", "variant", "ns_per_op", "ops"}) unless --tsv is given.
+// Only benchmarks whose name contains filter are run.
+
+namespace {
+
+template<typename T>
+inline void do_not_optimize(const T &value) {asm volatile("" : : "r,m"(value) : "memory");}
+
+struct Harness {
+    double min_seconds = 0.25;
+    bool tsv = false;
+    const char *filter = nullptr;
+
+    // func(n) performs n operations and returns the number actually performed.
+    void run(const char *name, const std::string &variant, const std::function<size_t(size_t)> &func) {
+        if(filter && std::strstr(name, filter) == nullptr) return;
+        size_t n = 1, ops = 0;
+        double elapsed = 0.;
+        for(;;) {
+            auto start = std::chrono::steady_clock::now();
+            ops = func(n);
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(elapsed >= min_seconds || n >= (size_t(1) << 40)) break;
+            n = elapsed <= 0. ? n * 16: std::max(n * 2, size_t(n * 1.4 * min_seconds / elapsed));
+        }
+        const double ns = elapsed * 1e9 / std::max(ops, size_t(1));
+        if(tsv) std::printf("%s\t%s\t%.3f\t%zu\n", name, variant.data(), ns, ops);
+        else    std::printf("{\"name\": \"%s\", \"variant\": \"%s\", \"ns_per_op\": %.3f, \"ops\": %zu}\n", name, variant.data(), ns, ops);
+        std::fflush(stdout);
+    }
+};
+
+std::string random_text(size_t len, std::mt19937_64 &mt, const char *alphabet="ACGT") {
+    const size_t alen = std::strlen(alphabet);
+    std::string ret(len, 0);
+    for(auto &c: ret) c = alphabet[mt() % alen];
+    return ret;
+}
+
+// Lines of nfields fields of up to field_len characters separated by delim.
+std::string random_table(size_t nlines, size_t nfields, size_t field_len, char delim, std::mt19937_64 &mt) {
+    std::string ret;
+    for(size_t i = 0; i < nlines; ++i) {
+        for(size_t j = 0; j < nfields; ++j) {
+            if(j) ret += delim;
+            ret += random_text(1 + mt() % field_len, mt, "abcdefghijklmnopqrstuvwxyz0123456789");
+        }
+        ret += '\n';
+    }
+    return ret;
+}
+
+void bench_string_append(Harness &h) {
+    std::mt19937_64 mt(1);
+    for(const size_t len: {8, 256}) {
+        const std::string piece = random_text(len, mt);
+        const std::string variant = "piece_len=" + std::to_string(len);
+        h.run("string_append", variant + ",impl=ks::string", [&](size_t n) {
+            ks::string s;
+            for(size_t i = 0; i < n; ++i) s.putsn(piece.data(), piece.size());
+            do_not_optimize(s.data());
+            return n;
+        });
+        h.run("string_append", variant + ",impl=std::string", [&](size_t n) {
+            std::string s;
+            for(size_t i = 0; i < n; ++i) s.append(piece);
+            do_not_optimize(s.data());
+            return n;
+        });
+    }
+    h.run("string_putc", "impl=ks::string", [&](size_t n) {
+        ks::string s;
+        for(size_t i = 0; i < n; ++i) s.putc('a' + (i & 15));
+        do_not_optimize(s.data());
+        return n;
+    });
+    h.run("string_putc", "impl=std::string", [&](size_t n) {
+        std::string s;
+        for(size_t i = 0; i < n; ++i) s.push_back('a' + (i & 15));
+        do_not_optimize(s.data());
+        return n;
+    });
+    h.run("string_putw", "impl=ks::string", [&](size_t n) {
+        ks::string s;
+        for(size_t i = 0; i < n; ++i) s.putw(int(i * 2654435761u));
+        do_not_optimize(s.data());
+        return n;
+    });
+    h.run("string_putw", "impl=std::to_string", [&](size_t n) {
+        std::string s;
+        for(size_t i = 0; i < n; ++i) s += std::to_string(int(i * 2654435761u));
+        do_not_optimize(s.data());
+        return n;
+    });
+}
+
+void bench_split(Harness &h) {
+    std::mt19937_64 mt(2);
+    const std::pair<char, const char *> delims[] {{'\t', "tab"}, {',', "comma"}, {' ', "whitespace"}};
+    for(const auto &d: delims) {
+        for(const size_t field_len: {4, 64}) {
+            const std::string table = random_table(64, 12, field_len, d.first, mt);
+            std::vector<std::string> lines;
+            for(size_t start = 0, end; (end = table.find('\n', start)) != std::string::npos; start = end + 1)
+                lines.push_back(table.substr(start, end - start));
+            const int ks_delim = d.first == ' ' ? 0: d.first;
+            const std::string variant = std::string("delim=") + d.second + ",field_len=" + std::to_string(field_len);
+            // One op is one line; bytes per line vary with field_len.
+            h.run("split", variant + ",impl=ks::split", [&](size_t n) {
+                std::vector<uint64_t> offsets;
+                ks::string buf;
+                for(size_t i = 0; i < n; ++i) {
+                    const std::string &line = lines[i % lines.size()];
+                    buf.clear();
+                    buf.putsn(line.data(), line.size());
+                    ks::split(buf.data(), ks_delim, buf.size(), offsets);
+                    do_not_optimize(offsets.data());
+                }
+                return n;
+            });
+            h.run("split", variant + ",impl=std::string::find", [&](size_t n) {
+                std::vector<uint64_t> offsets;
+                std::string buf;
+                for(size_t i = 0; i < n; ++i) {
+                    buf = lines[i % lines.size()];
+                    offsets.clear();
+                    for(size_t start = 0, end;; start = end + 1) {
+                        end = buf.find(d.first, start);
+                        offsets.push_back(start);
+                        if(end == std::string::npos) break;
+                        buf[end] = 0;
+                    }
+                    do_not_optimize(offsets.data());
+                }
+                return n;
+            });
+        }
+    }
+}
+
+void bench_search(Harness &h) {
+    std::mt19937_64 mt(3);
+    const ks::string text(random_text(1 << 20, mt));
+    for(const size_t plen: {8, 64}) {
+        std::vector<std::string> patterns;
+        for(size_t i = 0; i < 16; ++i) patterns.push_back(random_text(plen, mt));
+        // Half of the patterns occur in the text.
+        for(size_t i = 0; i < patterns.size(); i += 2) {
+            const size_t pos = mt() % (text.size() - plen);
+            patterns[i].assign(text.data() + pos, plen);
+        }
+        const std::string variant = "pattern_len=" + std::to_string(plen);
+        // One op is one byte of text scanned, up to the match.
+        auto scanned = [&](const char *hit) {return hit ? size_t(hit - text.data()) + plen: text.size();};
+        h.run("search", variant + ",impl=ks::locate", [&](size_t n) {
+            size_t bytes = 0;
+            for(size_t i = 0; i < n; ++i) {
+                const auto &p = patterns[i % patterns.size()];
+                bytes += scanned(text.locate(p.data(), p.size()));
+            }
+            return bytes;
+        });
+        h.run("search", variant + ",impl=ks::bmlocate", [&](size_t n) {
+            size_t bytes = 0;
+            for(size_t i = 0; i < n; ++i) {
+                const auto &p = patterns[i % patterns.size()];
+                bytes += scanned(text.bmlocate(p.data(), p.size()));
+            }
+            return bytes;
+        });
+        h.run("search", variant + ",impl=std::boyer_moore_searcher", [&](size_t n) {
+            size_t bytes = 0;
+            for(size_t i = 0; i < n; ++i) {
+                const auto &p = patterns[i % patterns.size()];
+                std::boyer_moore_searcher<std::string::const_iterator> searcher(p.begin(), p.end());
+                const char *hit = std::search(text.cbegin(), text.cend(), searcher);
+                bytes += scanned(hit == text.cend() ? nullptr: hit);
+            }
+            return bytes;
+        });
+    }
+}
+
+void bench_compare(Harness &h) {
+    std::mt19937_64 mt(14);
+    for(const size_t len: {7, 16, 64, 1000}) {
+        // Pairs of equal length differing in the last byte half of the time, as in a dedup pass.
+        const size_t npairs = 1024;
+        std::vector<std::string> a(npairs), b(npairs);
+        for(size_t i = 0; i < npairs; ++i) {
+            a[i] = b[i] = random_text(len, mt);
+            if(i & 1) b[i].back() ^= 1;
+        }
+        const std::string variant = "len=" + std::to_string(len);
+        // One op is one pair compared.
+        h.run("compare_equal", variant + ",impl=ks::bytes_equal", [&](size_t n) {
+            size_t eq = 0;
+            for(size_t i = 0; i < n; ++i) eq += ks::bytes_equal(a[i % npairs].data(), b[i % npairs].data(), len);
+            do_not_optimize(eq);
+            return n;
+        });
+        h.run("compare_equal", variant + ",impl=memcmp", [&](size_t n) {
+            size_t eq = 0;
+            for(size_t i = 0; i < n; ++i) eq += std::memcmp(a[i % npairs].data(), b[i % npairs].data(), len) == 0;
+            do_not_optimize(eq);
+            return n;
+        });
+        h.run("compare_order", variant + ",impl=ks::bytes_compare", [&](size_t n) {
+            int sum = 0;
+            for(size_t i = 0; i < n; ++i) sum += ks::bytes_compare(a[i % npairs].data(), len, b[i % npairs].data(), len) < 0;
+            do_not_optimize(sum);
+            return n;
+        });
+        h.run("compare_order", variant + ",impl=std::string_view::compare", [&](size_t n) {
+            int sum = 0;
+            for(size_t i = 0; i < n; ++i) sum += std::string_view(a[i % npairs]).compare(b[i % npairs]) < 0;
+            do_not_optimize(sum);
+            return n;
+        });
+    }
+}
+
+void bench_pool(Harness &h) {
+    struct node {uint64_t data[8];};
+    constexpr size_t BATCH = 1024;
+    std::vector<node *> ptrs(BATCH);
+    // One op is one allocation and one free, in batches of BATCH live objects.
+    h.run("pool", "impl=kmp::Pool", [&](size_t n) {
+        kmp::Pool<node> pool;
+        for(size_t i = 0; i < n; i += BATCH) {
+            for(auto &p: ptrs) p = pool.malloc();
+            do_not_optimize(ptrs.data());
+            for(auto p: ptrs) pool.free(p);
+        }
+        return (n + BATCH - 1) / BATCH * BATCH;
+    });
+    h.run("pool", "impl=kmp::SlabPool", [&](size_t n) {
+        kmp::SlabPool pool(sizeof(node));
+        for(size_t i = 0; i < n; i += BATCH) {
+            for(auto &p: ptrs) p = static_cast<node *>(pool.malloc());
+            do_not_optimize(ptrs.data());
+            for(auto p: ptrs) pool.free(p);
+        }
+        return (n + BATCH - 1) / BATCH * BATCH;
+    });
+    h.run("pool", "impl=malloc", [&](size_t n) {
+        for(size_t i = 0; i < n; i += BATCH) {
+            for(auto &p: ptrs) p = static_cast<node *>(std::malloc(sizeof(node)));
+            do_not_optimize(ptrs.data());
+            for(auto p: ptrs) std::free(p);
+        }
+        return (n + BATCH - 1) / BATCH * BATCH;
+    });
+}
+
+void bench_kbtree(Harness &h, size_t nkeys) {
+    std::mt19937_64 mt(4);
+    std::vector<uint64_t> random_keys(nkeys), sorted_keys(nkeys);
+    for(auto &k: random_keys) k = mt();
+    for(size_t i = 0; i < nkeys; ++i) sorted_keys[i] = i * 7;
+    const std::pair<const std::vector<uint64_t> *, const char *> orders[] {{&random_keys, "random"}, {&sorted_keys, "sorted"}};
+    for(const auto &order: orders) {
+        const auto &keys = *order.first;
+        const std::string variant = std::string("keys=") + order.second + ",n=" + std::to_string(nkeys);
+        // One op is one insertion; the container is rebuilt every nkeys insertions.
+        h.run("kbtree_put", variant + ",impl=kb::KBTree", [&](size_t n) {
+            for(size_t done = 0; done < n; done += keys.size()) {
+                kb::KBTree<uint64_t> tree;
+                for(const auto k: keys) tree.put(k);
+                do_not_optimize(tree.root);
+            }
+            return (n + keys.size() - 1) / keys.size() * keys.size();
+        });
+        h.run("kbtree_put", variant + ",impl=std::set", [&](size_t n) {
+            for(size_t done = 0; done < n; done += keys.size()) {
+                std::set<uint64_t> tree;
+                for(const auto k: keys) tree.insert(k);
+                do_not_optimize(tree.size());
+            }
+            return (n + keys.size() - 1) / keys.size() * keys.size();
+        });
+        kb::KBTree<uint64_t> tree;
+        std::set<uint64_t> set;
+        for(const auto k: keys) tree.put(k), set.insert(k);
+        h.run("kbtree_get", variant + ",impl=kb::KBTree", [&](size_t n) {
+            size_t found = 0;
+            for(size_t i = 0; i < n; ++i) found += tree.get(keys[(i * 2654435761u) % keys.size()] + (i & 1)) != nullptr;
+            do_not_optimize(found);
+            return n;
+        });
+        h.run("kbtree_get", variant + ",impl=std::set", [&](size_t n) {
+            size_t found = 0;
+            for(size_t i = 0; i < n; ++i) found += set.count(keys[(i * 2654435761u) % keys.size()] + (i & 1));
+            do_not_optimize(found);
+            return n;
+        });
+    }
+}
+
+void bench_kbtree_merge(Harness &h, size_t nkeys) {
+    std::mt19937_64 mt(12);
+    kb::KBTree<uint64_t> a, b;
+    for(size_t i = 0; i < nkeys; ++i) a.put(mt() % (nkeys * 4)), b.put(mt() % (nkeys * 4));
+    const std::string variant = "n=" + std::to_string(nkeys) + "+" + std::to_string(nkeys);
+    // One op is one input key.
+    h.run("kbtree_union", variant + ",impl=kb::set_union", [&](size_t n) {
+        for(size_t done = 0; done < n; done += 2 * nkeys) do_not_optimize(kb::set_union(a, b).size());
+        return (n + 2 * nkeys - 1) / (2 * nkeys) * 2 * nkeys;
+    });
+    h.run("kbtree_union", variant + ",impl=put", [&](size_t n) {
+        for(size_t done = 0; done < n; done += 2 * nkeys) {
+            kb::KBTree<uint64_t> out;
+            a.for_each([&out](const uint64_t &k) {out.put(k);});
+            b.for_each([&out, &a](const uint64_t &k) {if(a.get(k) == nullptr) out.put(k);});
+            do_not_optimize(out.size());
+        }
+        return (n + 2 * nkeys - 1) / (2 * nkeys) * 2 * nkeys;
+    });
+    // Absorbing disjoint shards: one op is one key moved into the accumulated tree.
+    const size_t nshards = 64, per_shard = std::max<size_t>(nkeys / nshards, 1);
+    h.run("kbtree_absorb", "shards=" + std::to_string(nshards) + ",n=" + std::to_string(nkeys) + ",impl=kb::KBTree::absorb", [&](size_t n) {
+        size_t moved = 0;
+        while(moved < n) {
+            kb::KBTree<uint64_t> acc;
+            for(size_t s = 0; s < nshards; ++s) {
+                kb::KBTree<uint64_t> shard;
+                for(size_t i = 0; i < per_shard; ++i) shard.put(s * per_shard + i);
+                acc.absorb(shard);
+            }
+            moved += nshards * per_shard;
+            do_not_optimize(acc.root);
+        }
+        return moved;
+    });
+}
+
+void bench_hashmap(Harness &h, size_t nkeys) {
+    std::mt19937_64 mt(5);
+    // Word counting: nkeys draws over nkeys / 8 distinct keys, looked up from a shared buffer without copying.
+    std::string text;
+    std::vector<std::pair<size_t, size_t>> words(nkeys);
+    std::vector<std::string> vocab(std::max<size_t>(nkeys / 8, 1));
+    for(auto &w: vocab) w = random_text(4 + mt() % 20, mt, "abcdefghijklmnopqrstuvwxyz");
+    for(auto &w: words) {
+        const std::string &v = vocab[mt() % vocab.size()];
+        w = {text.size(), v.size()};
+        text += v;
+    }
+    const std::string variant = "n=" + std::to_string(nkeys) + ",distinct=" + std::to_string(vocab.size());
+    h.run("hash_count", variant + ",impl=kh::FlatMap", [&](size_t n) {
+        kh::FlatMap<ks::string, uint64_t> map;
+        for(size_t i = 0; i < n; ++i) {
+            const auto &w = words[i % words.size()];
+            ++map[std::string_view(text.data() + w.first, w.second)];
+        }
+        do_not_optimize(map.size());
+        return n;
+    });
+    h.run("hash_count", variant + ",impl=std::unordered_map<std::string>", [&](size_t n) {
+        std::unordered_map<std::string, uint64_t> map;
+        for(size_t i = 0; i < n; ++i) {
+            const auto &w = words[i % words.size()];
+            ++map[std::string(text.data() + w.first, w.second)];
+        }
+        do_not_optimize(map.size());
+        return n;
+    });
+    h.run("hash_bytes", "len=16,impl=kh::hash", [&](size_t n) {
+        uint64_t acc = 0;
+        for(size_t i = 0; i < n; ++i) acc += kh::hash(text.data() + (i & 1023), 16);
+        do_not_optimize(acc);
+        return n;
+    });
+    h.run("hash_bytes", "len=16,impl=std::hash<std::string_view>", [&](size_t n) {
+        uint64_t acc = 0;
+        for(size_t i = 0; i < n; ++i) acc += std::hash<std::string_view>()(std::string_view(text.data() + (i & 1023), 16));
+        do_not_optimize(acc);
+        return n;
+    });
+}
+
+void bench_intern(Harness &h, size_t nkeys) {
+    std::mt19937_64 mt(6);
+    // A small repeated vocabulary, as in chromosome names or sample ids.
+    std::vector<std::string> vocab(64), words(nkeys);
+    for(auto &w: vocab) w = "chr" + random_text(1 + mt() % 8, mt, "0123456789XYM_");
+    for(auto &w: words) w = vocab[mt() % vocab.size()];
+    h.run("intern", "impl=kh::Interner", [&](size_t n) {
+        kh::Interner interner;
+        std::vector<kh::Interner::id_t> ids(words.size());
+        for(size_t i = 0; i < n; ++i) ids[i % words.size()] = interner.intern(words[i % words.size()]);
+        do_not_optimize(ids.data());
+        return n;
+    });
+    h.run("intern", "impl=kh::ConcurrentInterner", [&](size_t n) {
+        kh::ConcurrentInterner<> interner;
+        std::vector<kh::Interner::id_t> ids(words.size());
+        for(size_t i = 0; i < n; ++i) ids[i % words.size()] = interner.intern(words[i % words.size()]);
+        do_not_optimize(ids.data());
+        return n;
+    });
+    h.run("intern", "impl=ks::string", [&](size_t n) {
+        std::vector<ks::string> strs(words.size());
+        for(size_t i = 0; i < n; ++i) strs[i % words.size()] = ks::string(words[i % words.size()]);
+        do_not_optimize(strs.data());
+        return n;
+    });
+}
+
+void bench_sort(Harness &h, size_t nkeys) {
+    std::mt19937_64 mt(7);
+    // Keys share a prefix, as in read names or sample ids, so comparisons look past the first bytes.
+    std::vector<ks::string> input;
+    input.reserve(nkeys);
+    for(size_t i = 0; i < nkeys; ++i) input.emplace_back(std::string("SRR1234.") + random_text(4 + mt() % 12, mt, "0123456789"));
+    const std::string variant = "n=" + std::to_string(nkeys);
+    auto by_cmp = [](const ks::string &a, const ks::string &b) {return a.cmp(b) < 0;};
+    // One op is one element sorted; the time includes copying the input for each repetition.
+    auto run = [&](const std::string &impl, const std::function<void(std::vector<ks::string> &)> &sort) {
+        h.run("sort_strings", variant + ",impl=" + impl, [&](size_t n) {
+            size_t done = 0;
+            for(; done < n; done += input.size()) {
+                std::vector<ks::string> v(input);
+                sort(v);
+                do_not_optimize(v.data());
+            }
+            return done;
+        });
+    };
+    run("ks::sort_strings", [](std::vector<ks::string> &v) {ks::sort_strings(v);});
+    const unsigned nthreads = std::max(1u, std::thread::hardware_concurrency());
+    if(nthreads > 1) run("ks::sort_strings,threads=" + std::to_string(nthreads), [nthreads](std::vector<ks::string> &v) {ks::sort_strings(v, nthreads);});
+    run("std::sort", [&](std::vector<ks::string> &v) {std::sort(v.begin(), v.end(), by_cmp);});
+    run("std::stable_sort", [&](std::vector<ks::string> &v) {std::stable_sort(v.begin(), v.end(), by_cmp);});
+}
+
+void bench_approx_search(Harness &h) {
+    std::mt19937_64 mt(8);
+    const ks::string text(random_text(1 << 16, mt));
+    for(const size_t plen: {16, 100}) {
+        const std::string pattern = random_text(plen, mt);
+        const int k = int(plen / 8);
+        const std::string variant = "pattern_len=" + std::to_string(plen) + ",k=" + std::to_string(k);
+        // One op is one byte of text scanned.
+        h.run("approx_search", variant + ",impl=ks::MyersSearcher", [&](size_t n) {
+            const ks::MyersSearcher searcher(pattern);
+            size_t done = 0, hits = 0;
+            for(; done < n; done += text.size()) searcher.search(text, k, [&hits](size_t, int) {++hits;});
+            do_not_optimize(hits);
+            return done;
+        });
+        h.run("approx_search", variant + ",impl=naive_dp", [&](size_t n) {
+            std::vector<int> col(plen + 1);
+            size_t done = 0, hits = 0;
+            for(; done < n; done += text.size()) {
+                for(size_t i = 0; i <= plen; ++i) col[i] = i;
+                for(const char c: text) {
+                    int diag = 0;
+                    col[0] = 0;
+                    for(size_t i = 1; i <= plen; ++i) {
+                        const int up = col[i];
+                        col[i] = std::min({up + 1, col[i - 1] + 1, diag + (pattern[i - 1] != c)});
+                        diag = up;
+                    }
+                    hits += col[plen] <= k;
+                }
+            }
+            do_not_optimize(hits);
+            return done;
+        });
+        h.run("hamming_search", variant + ",impl=ks::HammingSearcher", [&](size_t n) {
+            const ks::HammingSearcher searcher(pattern);
+            size_t done = 0, hits = 0;
+            for(; done < n; done += text.size()) searcher.search(text, k, [&hits](size_t, int) {++hits;});
+            do_not_optimize(hits);
+            return done;
+        });
+        h.run("hamming_search", variant + ",impl=naive", [&](size_t n) {
+            size_t done = 0, hits = 0;
+            for(; done < n; done += text.size()) {
+                for(size_t i = 0; i + plen <= text.size(); ++i) {
+                    int d = 0;
+                    for(size_t j = 0; j < plen; ++j) d += text[i + j] != pattern[j];
+                    hits += d <= k;
+                }
+            }
+            do_not_optimize(hits);
+            return done;
+        });
+    }
+}
+
+void bench_parse(Harness &h) {
+    std::mt19937_64 mt(9);
+    std::vector<std::string> ints(4096), doubles(4096);
+    char buf[64];
+    for(auto &s: ints) s = std::to_string(int64_t(mt()) >> (mt() % 56));
+    for(auto &s: doubles) std::snprintf(buf, sizeof(buf), "%.*f", int(mt() % 8), double(int64_t(mt() % 2000000) - 1000000) / 1000.), s = buf;
+    // One op is one field parsed.
+    h.run("parse_int64", "impl=ks::parse", [&](size_t n) {
+        int64_t acc = 0, v = 0;
+        for(size_t i = 0; i < n; ++i) {const auto &s = ints[i % ints.size()]; ks::parse(s.data(), s.size(), v); acc += v;}
+        do_not_optimize(acc);
+        return n;
+    });
+    h.run("parse_int64", "impl=strtoll", [&](size_t n) {
+        int64_t acc = 0;
+        for(size_t i = 0; i < n; ++i) acc += std::strtoll(ints[i % ints.size()].data(), nullptr, 10);
+        do_not_optimize(acc);
+        return n;
+    });
+    h.run("parse_double", "impl=ks::parse", [&](size_t n) {
+        double acc = 0, v = 0;
+        for(size_t i = 0; i < n; ++i) {const auto &s = doubles[i % doubles.size()]; ks::parse(s.data(), s.size(), v); acc += v;}
+        do_not_optimize(acc);
+        return n;
+    });
+    h.run("parse_double", "impl=strtod", [&](size_t n) {
+        double acc = 0;
+        for(size_t i = 0; i < n; ++i) acc += std::strtod(doubles[i % doubles.size()].data(), nullptr);
+        do_not_optimize(acc);
+        return n;
+    });
+    // A numeric matrix: one op is one line of 4 doubles and 4 integers.
+    std::string table;
+    for(size_t i = 0; i < 4096; ++i) {
+        for(size_t j = 0; j < 8; ++j) table += (j ? "\t": "") + (j < 4 ? doubles[(i * 8 + j) % doubles.size()]: ints[(i * 8 + j) % ints.size()]);
+        table += '\n';
+    }
+    h.run("parse_table", "impl=ks::parse_columns", [&](size_t n) {
+        size_t done = 0;
+        for(; done < n; done += 4096) {
+            std::vector<double> a, b, c, d;
+            std::vector<int64_t> e, f, g, k;
+            ks::parse_columns(table.data(), table.size(), '\t', a, b, c, d, e, f, g, k);
+            do_not_optimize(k.data());
+        }
+        return done;
+    });
+    h.run("parse_table", "impl=ks::split+strtod", [&](size_t n) {
+        size_t done = 0;
+        std::vector<uint64_t> offsets;
+        for(; done < n; done += 4096) {
+            ks::string copy(table);
+            std::vector<std::vector<double>> cols(8);
+            char *p = copy.data();
+            for(char *line = p, *eol; (eol = std::strchr(line, '\n')) != nullptr; line = eol + 1) {
+                *eol = 0;
+                offsets.clear();
+                ks::split(line, '\t', eol - line, offsets);
+                for(size_t j = 0; j < offsets.size(); ++j) cols[j].push_back(j < 4 ? std::strtod(line + offsets[j], nullptr): double(std::strtoll(line + offsets[j], nullptr, 10)));
+            }
+            do_not_optimize(cols.data());
+        }
+        return done;
+    });
+}
+
+void bench_pipeline(Harness &h) {
+    std::mt19937_64 mt(10);
+    std::vector<std::string> ints(4096);
+    for(auto &s: ints) s = std::to_string(int64_t(mt()) >> (mt() % 40));
+    std::string table;
+    for(size_t i = 0; table.size() < (size_t(1) << 24); ++i) {
+        for(size_t j = 0; j < 8; ++j) table += (j ? "\t": "") + ints[(i * 8 + j) % ints.size()];
+        table += '\n';
+    }
+    // Sum each line's fields, writing one number per line.
+    auto work = [](ks::string &in, ks::string &out) {
+        for(const char *line = in.data(), *end = in.data() + in.size(); line < end;) {
+            const char *eol = static_cast<const char *>(std::memchr(line, '\n', end - line));
+            if(eol == nullptr) eol = end;
+            int64_t sum = 0, x = 0;
+            for(const char *f = line; f < eol;) {
+                const char *fe = static_cast<const char *>(std::memchr(f, '\t', eol - f));
+                if(fe == nullptr) fe = eol;
+                ks::parse(f, fe - f, x);
+                sum += x;
+                f = fe + 1;
+            }
+            out.putl(sum);
+            out.putc('\n');
+            line = eol + 1;
+        }
+    };
+    // One op is one byte of input.
+    const unsigned nthreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> worker_counts {1};
+    if(nthreads > 1) worker_counts.push_back(nthreads);
+    for(const unsigned nworkers: worker_counts) {
+        h.run("pipeline", "workers=" + std::to_string(nworkers) + ",impl=kt::run_pipeline", [&](size_t n) {
+            size_t done = 0;
+            for(; done < n; done += table.size()) {
+                size_t pos = 0, written = 0;
+                kt::pipeline_opts_t opts;
+                opts.nworkers = nworkers;
+                opts.block_bytes = 1 << 20;
+                kt::run_pipeline([&](char *buf, size_t len) -> ptrdiff_t {
+                    len = std::min(len, table.size() - pos);
+                    std::memcpy(buf, table.data() + pos, len);
+                    pos += len;
+                    return len;
+                }, work, [&](const ks::string &out) {written += out.size();}, opts);
+                do_not_optimize(written);
+            }
+            return done;
+        });
+    }
+    h.run("pipeline", "workers=0,impl=sequential", [&](size_t n) {
+        size_t done = 0;
+        for(; done < n; done += table.size()) {
+            ks::string in(table), out;
+            work(in, out);
+            do_not_optimize(out.size());
+        }
+        return done;
+    });
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Harness h;
+    size_t nkeys = 1000000;
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "--quick") == 0) h.min_seconds = 0.002, nkeys = 10000;
+        else if(std::strcmp(argv[i], "--tsv") == 0) h.tsv = true;
+        else h.filter = argv[i];
+    }
+    if(h.tsv) std::printf("#name\tvariant\tns_per_op\tops\n");
+    bench_string_append(h);
+    bench_split(h);
+    bench_parse(h);
+    bench_pipeline(h);
+    bench_search(h);
+    bench_approx_search(h);
+    bench_compare(h);
+    bench_pool(h);
+    bench_kbtree(h, nkeys);
+    bench_kbtree_merge(h, nkeys);
+    bench_hashmap(h, nkeys);
+    bench_intern(h, nkeys);
+    bench_sort(h, nkeys);
+}
@@ -1,11 +1,20 @@
 #ifndef KBTREE_WRAPPER_H__
 #define KBTREE_WRAPPER_H__
-#include "klib/kbtree.h"
+#include "kmp.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <cassert>
 
+#ifndef KB_DEFAULT_SIZE
+#define KB_DEFAULT_SIZE 512
+#endif
+
 #ifndef unlikely
 #define unlikely(x) __builtin_expect((x), 0)
 #endif
@@ -23,20 +32,59 @@ struct DefaultCmp {
     }
 };
 
-template<typename KeyType, typename Cmp=DefaultCmp, size_t MAX_DEPTH_PARAM=64>
+/*
+ * Node allocation policies.
+ * A policy is constructed from the internal and leaf node sizes and provides
+ * allocate(is_internal) returning zeroed memory, deallocate(p, is_internal),
+ * and release(), which frees all nodes at once when bulk_release is true.
+ * Otherwise, the tree frees each node on destruction.
+ * absorb(other) takes ownership of the nodes allocated by another policy of the
+ * same sizes, so that trees can be joined without copying.
+ */
+struct MallocNodeAlloc {
+    static constexpr bool bulk_release = false;
+    size_t ilen_, elen_;
+    MallocNodeAlloc(size_t ilen, size_t elen): ilen_(ilen), elen_(elen) {}
+    void *allocate(bool is_internal) {
+        void *ret = std::calloc(1, is_internal ? ilen_: elen_);
+        if(ret == nullptr) throw std::bad_alloc();
+        return ret;
+    }
+    void deallocate(void *p, bool) {std::free(p);}
+    void release() {}
+    void absorb(MallocNodeAlloc &) {}
+};
+
+struct SlabNodeAlloc {
+    // Carves internal and leaf nodes from separate slab pools so that siblings
+    // sit close together and teardown is O(number of slabs).
+    static constexpr bool bulk_release = true;
+    kmp::SlabPool internal_, leaf_;
+    SlabNodeAlloc(size_t ilen, size_t elen): internal_(ilen), leaf_(elen) {}
+    void *allocate(bool is_internal) {return (is_internal ? internal_: leaf_).calloc();}
+    void deallocate(void *p, bool is_internal) {(is_internal ? internal_: leaf_).free(p);}
+    void release() {internal_.clear(); leaf_.clear();}
+    void absorb(SlabNodeAlloc &o) {internal_.absorb(o.internal_); leaf_.absorb(o.leaf_);}
+};
+
+template<typename KeyType, typename Cmp=DefaultCmp, size_t MAX_DEPTH_PARAM=64, typename NodeAlloc=SlabNodeAlloc>
 class KBTree {
 public:
     using key_t = KeyType;
     using pointer = key_t *;
     using const_pointer = const key_t *;
+    using alloc_t = NodeAlloc;
     static constexpr size_t MAX_DEPTH = MAX_DEPTH_PARAM;
+    // Keys follow the 4-byte node header, padded to the key's alignment.
+    static constexpr size_t KEY_OFFSET = (4 + alignof(key_t) - 1) / alignof(key_t) * alignof(key_t);
+    static constexpr size_t align_ptr(size_t x) {return (x + alignof(void *) - 1) / alignof(void *) * alignof(void *);}
 
     struct node_t {int32_t is_internal:1, n:31;};
     struct pos_t  {node_t *x; int i;};
     struct iter_t {
         pos_t stack[MAX_DEPTH], *p;
 
-        iter_t(KBTree &ref): p(nullptr) {
+        iter_t(const KBTree &ref): p(nullptr) {
             if(unlikely(ref.n_keys == 0)) throw std::runtime_error("Could not initialize iterator over empty sequence.");
             p = stack;
             p->x = ref.root; p->i = 0;
@@ -47,98 +95,106 @@ public:
             }
         }
         key_t &key() {
-            return reinterpret_cast<key_t *>(reinterpret_cast<char *>(p->x) + 4)[p->i];
+            return reinterpret_cast<key_t *>(reinterpret_cast<char *>(p->x) + KEY_OFFSET)[p->i];
         }
         const key_t &key() const {
-            return reinterpret_cast<key_t *>(reinterpret_cast<char *>(p->x) + 4)[p->i];
+            return reinterpret_cast<key_t *>(reinterpret_cast<char *>(p->x) + KEY_OFFSET)[p->i];
         }
         const key_t &const_key() const {
 #if !NDEBUG
-            auto ptr = reinterpret_cast<key_t *>(reinterpret_cast<char *>(p->x) + 4) + p->i;
+            auto ptr = reinterpret_cast<key_t *>(reinterpret_cast<char *>(p->x) + KEY_OFFSET) + p->i;
             if(ptr == nullptr) {
                 std::fprintf(stderr, "Warning: Null key at position\n");
             }
 #endif
-            return reinterpret_cast<key_t *>(reinterpret_cast<char *>(p->x) + 4)[p->i];
+            return reinterpret_cast<key_t *>(reinterpret_cast<char *>(p->x) + KEY_OFFSET)[p->i];
         }
         bool valid() const {return p >= stack;}
     };
 
     int t, n;
     int off_key, off_ptr, ilen, elen;
+    alloc_t alloc;
     node_t *root;
     int n_keys, n_nodes;
+    size_t node_size;
     KBTree(size_t size=KB_DEFAULT_SIZE):
         t(((size - 4 - sizeof(void *)) / (sizeof(void *) + sizeof(key_t)) + 1) >>1), n((t<<1) - 1),
-        off_ptr(4 + n * sizeof(key_t)), ilen((4 + sizeof(void *) + n * (sizeof(void *) + sizeof(key_t)) + 3) >> 2 << 2),
-        root(t >= 2 ? static_cast<node_t *>(std::calloc(1, ilen)): nullptr),
-        off_key(0),
-        elen((off_ptr + 3) >> 2 << 2), n_keys(0), n_nodes(1)
+        off_key(KEY_OFFSET), off_ptr(align_ptr(KEY_OFFSET + n * sizeof(key_t))),
+        ilen(off_ptr + (n + 1) * sizeof(void *)),
+        elen(off_ptr),
+        alloc(ilen, elen),
+        root(nullptr), n_keys(0), n_nodes(1), node_size(size)
     {
-        if(!root) throw std::invalid_argument(std::string("t must be >= 2. t: ") + std::to_string(t));
-    };
-    node_t **ptr(node_t *x) {
-        return reinterpret_cast<node_t **>(reinterpret_cast<char *>(this) + off_ptr);
-    }
-    const node_t **ptr(node_t *x) const {
-        return reinterpret_cast<const node_t **>(reinterpret_cast<const char *>(this) + off_ptr);
-    }
-    int proot(std::FILE *fp=stderr) const {return std::fprintf(fp, "root: %p\n", root);}
-    ~KBTree() {
-        std::fprintf(stderr, "Calling destructor\n");
-#if 0
-        top = stack = (kbnode_t**)calloc(max, sizeof(kbnode_t*));
-            *top++ = (b)->root;
-            while (top != stack) {
+        if(t < 2) throw std::invalid_argument(std::string("t must be >= 2. t: ") + std::to_string(t));
+        root = new_node(true);
+    }
+    KBTree(const KBTree &) = delete;
+    KBTree &operator=(const KBTree &) = delete;
+    KBTree(KBTree &&o): KBTree(o.node_size) {swap(o);}
+    // Frees the current contents; o is left empty, as after the move constructor.
+    KBTree &operator=(KBTree &&o) {
+        if(this != &o) {clear(); swap(o);}
+        return *this;
+    }
+    void swap(KBTree &o) {
+        std::swap(t, o.t); std::swap(n, o.n);
+        std::swap(off_key, o.off_key); std::swap(off_ptr, o.off_ptr); std::swap(ilen, o.ilen); std::swap(elen, o.elen);
+        std::swap(alloc, o.alloc); std::swap(root, o.root);
+        std::swap(n_keys, o.n_keys); std::swap(n_nodes, o.n_nodes); std::swap(node_size, o.node_size);
+    }
+    node_t *new_node(bool is_internal) {
+        return static_cast<node_t *>(alloc.allocate(is_internal));
+    }
+    node_t **ptr(node_t *x) const {
+        return reinterpret_cast<node_t **>(reinterpret_cast<char *>(x) + off_ptr);
+    }
+    int proot(std::FILE *fp=stderr) const {return std::fprintf(fp, "root: %p\n", static_cast<void *>(root));}
+    void destroy() {
+        if(root == nullptr) return;
+        if(alloc_t::bulk_release) {
+            alloc.release();
+        } else {
+            // The root is always allocated with internal size, so it is freed as such.
+            size_t max = 8;
+            node_t *x, **top, **stack;
+            if((top = stack = static_cast<node_t **>(std::malloc(max * sizeof(node_t *)))) == nullptr) throw std::bad_alloc();
+            *top++ = root;
+            while(top != stack) {
                 x = *--top;
-                if (x->is_internal == 0) { free(x); continue; }
-                for (i = 0; i <= x->n; ++i)
-                    if (__KB_PTR(b, x)[i]) {
-                        if (top - stack == max) {
+                if(x->is_internal) {
+                    for(int i = 0; i <= x->n; ++i) {
+                        if(ptr(x)[i] == nullptr) continue;
+                        if(static_cast<size_t>(top - stack) == max) {
+                            const size_t used = top - stack;
                             max <<= 1;
-                            stack = (kbnode_t**)realloc(stack, max * sizeof(kbnode_t*));
-                            top = stack + (max>>1);
+                            node_t **tmp = static_cast<node_t **>(std::realloc(stack, max * sizeof(node_t *)));
+                            if(tmp == nullptr) {std::free(stack); throw std::bad_alloc();}
+                            top = tmp + used;
+                            stack = tmp;
                         }
-                        *top++ = __KB_PTR(b, x)[i];
+                        *top++ = ptr(x)[i];
                     }
-                free(x);
-            }
-        }
-        free(stack);
-#endif
-        int i, max = 8;
-        node_t *x, **top, **stack = 0;
-        std::fprintf(stderr, "Allocating workspace\n");
-        proot(stderr);
-        top = stack = static_cast<node_t **>(std::calloc(max, sizeof(node_t *)));
-        assert(stack); assert(top);
-        std::fprintf(stderr, "Further down. top ptr: %p, root %p\n", static_cast<void *>(top), static_cast<void *>(root));
-        *top++ = root;
-        std::fprintf(stderr, "root ptr: %p\n", static_cast<void *>(root));
-        std::fflush(stderr);
-        while(top != stack) {
-            x = *--top;
-            assert(x);
-            if(x->is_internal == 0) {std::free(x); continue;}
-            for(i = 0; i <= n; ++i) {
-                if (ptr(x)[i]) {
-                    if(top - stack == max) {
-                        max <<= 1;
-                        stack = static_cast<node_t **>(std::realloc(stack, max * sizeof(node_t *)));
-                    }
-                    *top++ = ptr(x)[i];
                 }
-                std::free(x);
+                alloc.deallocate(x, x->is_internal || x == root);
             }
             std::free(stack);
         }
+        root = nullptr;
+        n_keys = 0; n_nodes = 0;
+    }
+    ~KBTree() {destroy();}
+    void clear() {
+        destroy();
+        root = new_node(true);
+        n_nodes = 1;
     }
     int cmp(const KeyType &a, const KeyType &b) const {return Cmp()(a, b);}
     static key_t *key(node_t *node) {
-        return reinterpret_cast<key_t *>(reinterpret_cast<char *>(node) + 4);
+        return reinterpret_cast<key_t *>(reinterpret_cast<char *>(node) + KEY_OFFSET);
     }
     static const key_t *key(const node_t *node) {
-        return reinterpret_cast<const key_t *>(reinterpret_cast<const char *>(node) + 4);
+        return reinterpret_cast<const key_t *>(reinterpret_cast<const char *>(node) + KEY_OFFSET);
     }
     static int get_aux(const node_t * __restrict x, const key_t * __restrict k, int *r) {
         int tr, *rr, begin = 0, end = x->n;
@@ -146,15 +202,18 @@ public:
         rr = r ? r: &tr;
         while(begin < end) {
             int mid = (begin + end) >> 1;
+            KSTAT_ADD(kb_comparisons, 1);
             if(Cmp()(key(x)[mid], *k) < 0) begin = mid + 1;
             else end = mid;
         }
         if(begin == x->n) { *rr = 1; return x->n - 1;}
+        KSTAT_ADD(kb_comparisons, 1);
         begin -= (*rr = Cmp()(*k, key(x)[begin])) < 0;
         return begin;
     }
     key_t *get(const key_t * __restrict k) {
         int i, r = 0;
+        KSTAT_ADD(kb_lookups, 1);
         node_t *x = root;
         while (x) {
             i = get_aux(x, k, &r);
@@ -166,6 +225,7 @@ public:
     }
     const key_t *get(const key_t * __restrict k) const {
         int i, r = 0;
+        KSTAT_ADD(kb_lookups, 1);
         node_t *x = root;
         while (x) {
             i = get_aux(x, k, &r);
@@ -178,6 +238,22 @@ public:
     key_t *get(key_t k) {return get(&k);}
     const key_t *get(key_t k) const {return get(&k);}
     auto size() const {return n_keys;}
+    int height() const {
+        int ret = 1;
+        for(const node_t *x = root; x->is_internal; x = ptr(const_cast<node_t *>(x))[0]) ++ret;
+        return ret;
+    }
+    // Smallest and largest keys. The tree must not be empty.
+    const key_t &front() const {
+        node_t *x = root;
+        while(x->is_internal) x = ptr(x)[0];
+        return key(x)[0];
+    }
+    const key_t &back() const {
+        node_t *x = root;
+        while(x->is_internal) x = ptr(x)[x->n];
+        return key(x)[x->n - 1];
+    }
     void interval(const key_t * __restrict k, key_t **lower, key_t **upper) {
         int i, r = 0;
         node_t *x = root;
@@ -188,7 +264,7 @@ public:
                 *lower = *upper = &key(x)[i];
                 return;
             }
-            if (i >= 0) *lower = &__KB_KEY(key_t, x)[i];
+            if (i >= 0) *lower = &key(x)[i];
             if (i < x->n - 1) *upper = &key(x)[i + 1];
             if (x->is_internal == 0) return;
             x = ptr(x)[i + 1];
@@ -198,7 +274,8 @@ public:
         interval(&k, lower, upper);
     }
     void split(node_t *x, int i, node_t *y) {
-        node_t *z = static_cast<node_t *>(std::calloc(1, y->is_internal ? ilen: elen));
+        node_t *z = new_node(y->is_internal);
+        KSTAT_ADD(kb_splits, 1);
         ++n_nodes;
         z->is_internal = y->is_internal;
         z->n = this->t - 1;
@@ -214,6 +291,7 @@ public:
     key_t *put_aux(node_t *x, const key_t * __restrict k) {
         int i = x->n - 1;
         key_t *ret;
+        KSTAT_ADD(kb_put_depth, 1);
         if (x->is_internal == 0) {
             if((i = get_aux(x, k, 0)) != x->n - 1)
                 std::memmove(key(x) + i + 2, key(x) + i + 1, (x->n - i - 1) * sizeof(key_t));
@@ -236,10 +314,11 @@ public:
     key_t *put(const key_t * __restrict k) {
         node_t *r, *s;
         ++this->n_keys;
+        KSTAT_ADD(kb_puts, 1);
         r = this->root;
         if (r->n == 2 * this->t - 1) {
             ++this->n_nodes;
-            this->root = s = static_cast<node_t*>(calloc(1, this->ilen));
+            this->root = s = new_node(true);
             s->is_internal = 1; s->n = 0;
             ptr(s)[0] = r;
             split(s, 0, r);
@@ -259,8 +338,9 @@ public:
             itr.p[1].i = i;
             ++itr.p;
         }
+        return -1;
     }
-    int itr_next(iter_t &itr) {
+    int itr_next(iter_t &itr) const {
         if(itr.p < itr.stack) return 0;
         for(;;) {
             ++itr.p->i;
@@ -274,20 +354,262 @@ public:
             if (itr.p->x && itr.p->i < itr.p->x->n) return 1;
         }
     }
-    int itr_next(iter_t *itr) {return itr_next(*itr);}
+    int itr_next(iter_t *itr) const {return itr_next(*itr);}
     template<typename Func>
     void for_each(const Func &func) {
-        proot(stderr);
+        if(n_keys == 0) return;
         for(iter_t it(*this); it.valid(); func(it.key()), itr_next(it));
     }
     template<typename Func>
     void for_each(const Func &func) const {
-        proot(stderr);
+        if(n_keys == 0) return;
         for(iter_t it(*this); it.valid(); func(it.const_key()), itr_next(it));
     }
-    // TODO: Delete
+
+    /*
+     * Bulk construction. Keys are appended in non-decreasing order along the right
+     * spine: each goes into the lowest spine node with room, and if that is not the
+     * leaf, fresh empty nodes are hung below it. Every node but those on the right
+     * edge is left full, and finish() tops the right edge up to t - 1 keys by
+     * shifting keys over from the left siblings. O(1) amortized per key.
+     * Keys go into a scratch tree which replaces the target only in finish(), so
+     * if add() throws (e.g. on unsorted input) the target keeps its contents and
+     * the partial tree is freed with the builder.
+     */
+    class builder_t {
+        KBTree &target_;
+        std::unique_ptr<KBTree> scratch_;
+        KBTree &tree_;
+        node_t *spine_[MAX_DEPTH];  // spine_[0] is the rightmost leaf.
+        int height_;
+        const key_t *last_;
+    public:
+        builder_t(KBTree &target): target_(target), scratch_(new KBTree(target.node_size)), tree_(*scratch_), height_(0), last_(nullptr) {
+            tree_.destroy();
+        }
+        ~builder_t() {
+            // Every node added so far hangs off the spine, so the scratch tree's destroy() frees them.
+            if(scratch_ && height_) scratch_->root = spine_[height_ - 1];
+        }
+        builder_t(const builder_t &) = delete;
+        builder_t &operator=(const builder_t &) = delete;
+        void add(const key_t &k) {
+            if(last_ && Cmp()(k, *last_) < 0) throw std::invalid_argument("Keys must be added in non-decreasing order.");
+            int lvl = 0;
+            while(lvl < height_ && spine_[lvl]->n == tree_.n) ++lvl;
+            if(lvl == height_) {
+                if(height_ == int(MAX_DEPTH)) throw std::runtime_error("Bulk-built tree exceeds MAX_DEPTH.");
+                node_t *x = tree_.new_node(true);
+                if(height_) x->is_internal = 1, tree_.ptr(x)[0] = spine_[height_ - 1];
+                spine_[height_++] = x;
+                ++tree_.n_nodes;
+            }
+            node_t *x = spine_[lvl];
+            key_t *dst = key(x) + x->n++;
+            *dst = k;
+            last_ = dst;
+            while(lvl-- > 0) {
+                node_t *y = tree_.new_node(lvl > 0);
+                if(lvl > 0) y->is_internal = 1;
+                tree_.ptr(spine_[lvl + 1])[spine_[lvl + 1]->n] = y;
+                spine_[lvl] = y;
+                ++tree_.n_nodes;
+            }
+            ++tree_.n_keys;
+        }
+        void finish() {
+            if(!scratch_) throw std::logic_error("builder_t::finish called twice.");
+            const int t = tree_.t;
+            if(height_ == 0) {
+                tree_.root = tree_.new_node(true);
+                tree_.n_nodes = 1;
+                target_.swap(tree_);
+                scratch_.reset();
+                return;
+            }
+            for(int lvl = height_ - 2; lvl >= 0; --lvl) {
+                node_t *p = spine_[lvl + 1], *r = spine_[lvl];
+                const int d = (t - 1) - r->n;
+                if(d <= 0) continue;
+                // Rotate d keys through the separator from the full left sibling l.
+                node_t *l = tree_.ptr(p)[p->n - 1];
+                std::memmove(key(r) + d, key(r), sizeof(key_t) * r->n);
+                key(r)[d - 1] = key(p)[p->n - 1];
+                std::memcpy(key(r), key(l) + l->n - d + 1, sizeof(key_t) * (d - 1));
+                key(p)[p->n - 1] = key(l)[l->n - d];
+                if(r->is_internal) {
+                    std::memmove(tree_.ptr(r) + d, tree_.ptr(r), sizeof(void *) * (r->n + 1));
+                    std::memcpy(tree_.ptr(r), tree_.ptr(l) + l->n - d + 1, sizeof(void *) * d);
+                }
+                l->n -= d;
+                r->n += d;
+            }
+            // The root was allocated as an internal node, whatever its level.
+            tree_.root = spine_[height_ - 1];
+            height_ = 0;
+            target_.swap(tree_);
+            scratch_.reset(); // Frees the target's previous contents.
+        }
+    };
+    // Replaces the contents with the sorted range [first, last).
+    template<typename It>
+    void assign_sorted(It first, It last) {
+        builder_t b(*this);
+        for(; first != last; ++first) b.add(*first);
+        b.finish();
+    }
+
+    // Keys kept by merge_walk.
+    enum merge_mode: unsigned {KEEP_A = 1, KEEP_B = 2, KEEP_COMMON = 4, KEEP_BOTH_COPIES = 8};
+    // Walks a and b in order like the std::set_* algorithms, calling emit on each kept key.
+    // Equal keys are paired one to one; KEEP_COMMON emits a's copy, and KEEP_BOTH_COPIES b's as well.
+    template<typename Emit>
+    static void merge_walk(const KBTree &a, const KBTree &b, unsigned mode, const Emit &emit) {
+        if(a.n_keys == 0 || b.n_keys == 0) {
+            if(mode & KEEP_A) a.for_each(emit);
+            if(mode & KEEP_B) b.for_each(emit);
+            return;
+        }
+        iter_t ia(a), ib(b);
+        while(ia.valid() && ib.valid()) {
+            const key_t &x = ia.const_key(), &y = ib.const_key();
+            const int c = Cmp()(x, y);
+            if(c < 0) {
+                if(mode & KEEP_A) emit(x);
+                a.itr_next(ia);
+            } else if(c > 0) {
+                if(mode & KEEP_B) emit(y);
+                b.itr_next(ib);
+            } else {
+                if(mode & KEEP_COMMON) {
+                    emit(x);
+                    if(mode & KEEP_BOTH_COPIES) emit(y);
+                }
+                a.itr_next(ia); b.itr_next(ib);
+            }
+        }
+        if(mode & KEEP_A) for(; ia.valid(); a.itr_next(ia)) emit(ia.const_key());
+        if(mode & KEEP_B) for(; ib.valid(); b.itr_next(ib)) emit(ib.const_key());
+    }
+    // A new tree, with a's node size, holding the keys merge_walk keeps.
+    static KBTree merged(const KBTree &a, const KBTree &b, unsigned mode) {
+        KBTree ret(a.node_size);
+        builder_t builder(ret);
+        merge_walk(a, b, mode, [&builder](const key_t &k) {builder.add(k);});
+        builder.finish();
+        return ret;
+    }
+
+    // Moves every key of other into this tree, leaving other empty.
+    // If the key ranges do not overlap, the two trees are joined in O(height) by
+    // splicing other's nodes (and allocator slabs) into this tree under one separator
+    // key. Otherwise both are merged into a new tree in linear time.
+    void absorb(KBTree &other) {
+        if(&other == this || other.n_keys == 0) return;
+        if(other.t != t) throw std::invalid_argument("absorb requires trees with the same node size.");
+        if(n_keys == 0) {
+            swap(other);
+            return;
+        }
+        const bool other_after = Cmp()(back(), other.front()) <= 0;
+        if(other_after || Cmp()(other.back(), front()) <= 0) {
+            if(!other_after) swap(other);
+            if(join(other)) return;
+        }
+        KBTree tmp(merged(*this, other, KEEP_A | KEEP_B | KEEP_COMMON | KEEP_BOTH_COPIES));
+        swap(tmp);
+        other.clear();
+    }
+
+private:
+    // Appends right, all of whose keys are >= ours. Returns false without changes
+    // if neither edge leaf can spare a key to serve as the separator.
+    bool join(KBTree &right) {
+        node_t *lleaf = root, *rleaf = right.root;
+        while(lleaf->is_internal) lleaf = ptr(lleaf)[lleaf->n];
+        while(rleaf->is_internal) rleaf = right.ptr(rleaf)[0];
+        key_t sep;
+        if(lleaf->n > 1) {
+            sep = key(lleaf)[--lleaf->n];
+        } else if(rleaf->n > 1) {
+            sep = key(rleaf)[0];
+            std::memmove(key(rleaf), key(rleaf) + 1, sizeof(key_t) * --rleaf->n);
+        } else return false;
+        const int hl = height(), hr = right.height();
+        alloc.absorb(right.alloc);
+        const int nnodes = n_nodes + right.n_nodes;
+        if(hl == hr) {
+            node_t *s = new_node(true);
+            s->is_internal = 1; s->n = 1;
+            key(s)[0] = sep;
+            ptr(s)[0] = root; ptr(s)[1] = right.root;
+            root = s;
+            n_nodes = nnodes + 1;
+        } else {
+            // Descend the taller tree's facing spine, splitting full nodes on the way,
+            // to the node whose children are at the shorter tree's root level.
+            const bool left_taller = hl > hr;
+            node_t *top = left_taller ? root: right.root;
+            n_nodes = nnodes;
+            int lvl = std::max(hl, hr) - 1;
+            if(top->n == n) {
+                node_t *s = new_node(true);
+                s->is_internal = 1; s->n = 0;
+                ptr(s)[0] = top;
+                split(s, 0, top);
+                top = s;
+                ++lvl;
+                ++n_nodes;
+            }
+            node_t *x = top;
+            for(; lvl > std::min(hl, hr); --lvl) {
+                int i = left_taller ? x->n: 0;
+                if(ptr(x)[i]->n == n) {
+                    split(x, i, ptr(x)[i]);
+                    if(left_taller) ++i;
+                }
+                x = ptr(x)[i];
+            }
+            if(left_taller) {
+                key(x)[x->n] = sep;
+                ptr(x)[x->n + 1] = right.root;
+            } else {
+                std::memmove(key(x) + 1, key(x), sizeof(key_t) * x->n);
+                std::memmove(ptr(x) + 1, ptr(x), sizeof(void *) * (x->n + 1));
+                key(x)[0] = sep;
+                ptr(x)[0] = root;
+            }
+            ++x->n;
+            root = top;
+        }
+        n_keys += right.n_keys;
+        // right's nodes now belong to this tree; give it a fresh root.
+        right.root = right.new_node(true);
+        right.n_keys = 0; right.n_nodes = 1;
+        return true;
+    }
 };
 
+// Set operations with std::set_* semantics: for a key held i times in a and j
+// times in b, union keeps max(i, j) copies, intersection min(i, j) and difference
+// max(i - j, 0). Both trees are walked once in order and the result is bulk-built,
+// so each is linear in the total size.
+template<typename K, typename C, size_t D, typename A>
+KBTree<K, C, D, A> set_union(const KBTree<K, C, D, A> &a, const KBTree<K, C, D, A> &b) {
+    using T = KBTree<K, C, D, A>;
+    return T::merged(a, b, T::KEEP_A | T::KEEP_B | T::KEEP_COMMON);
+}
+template<typename K, typename C, size_t D, typename A>
+KBTree<K, C, D, A> set_intersection(const KBTree<K, C, D, A> &a, const KBTree<K, C, D, A> &b) {
+    using T = KBTree<K, C, D, A>;
+    return T::merged(a, b, T::KEEP_COMMON);
+}
+template<typename K, typename C, size_t D, typename A>
+KBTree<K, C, D, A> set_difference(const KBTree<K, C, D, A> &a, const KBTree<K, C, D, A> &b) {
+    using T = KBTree<K, C, D, A>;
+    return T::merged(a, b, T::KEEP_A);
+}
+
 
 } // namespace kb
 
@@ -0,0 +1,269 @@
+#ifndef KBTREE_IMAGE_H__
+#define KBTREE_IMAGE_H__
+#include "kb.h"
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Pointer-free file image of a kb::KBTree and a read-only view over it.
+ *
+ * Layout: an image_header_t, followed by nodes in breadth-first order. Each node is
+ *   uint32_t is_internal, uint32_t n, key_t keys[n], and, for internal nodes,
+ *   uint64_t children[n + 1] holding byte offsets from the start of the image.
+ * Nodes start at IMAGE_ALIGN boundaries, so keys can be read in place.
+ * Keys are stored verbatim and must be trivially copyable; images are only
+ * portable between hosts with the same endianness and key layout.
+ * KBView checks every node offset it follows against the image size and bounds
+ * the depth of every descent, so a corrupt or truncated image throws
+ * std::runtime_error rather than reading outside the mapping. Key contents are
+ * not checked: a corrupt image may give wrong answers, but no invalid reads.
+ */
+
+namespace kb {
+
+static constexpr uint64_t IMAGE_MAGIC   = 0x31474d4942424b4bULL; // "KKBBIMG1"
+static constexpr uint32_t IMAGE_VERSION = 1;
+static constexpr size_t   IMAGE_ALIGN   = 16;
+
+struct image_header_t {
+    uint64_t magic;
+    uint32_t version, key_size;
+    uint64_t n_keys, n_nodes;
+    uint64_t root_off, image_size;
+};
+
+namespace detail {
+static constexpr size_t image_align(size_t x, size_t a=IMAGE_ALIGN) {return (x + a - 1) / a * a;}
+template<typename key_t>
+static constexpr size_t image_key_offset() {return image_align(2 * sizeof(uint32_t), alignof(key_t));}
+template<typename key_t>
+static constexpr size_t image_child_offset(size_t n) {return image_align(image_key_offset<key_t>() + n * sizeof(key_t), alignof(uint64_t));}
+template<typename key_t>
+static constexpr size_t image_node_size(bool is_internal, size_t n) {
+    return image_align(is_internal ? image_child_offset<key_t>(n) + (n + 1) * sizeof(uint64_t): image_key_offset<key_t>() + n * sizeof(key_t));
+}
+} // namespace detail
+
+// Writes tree to fp. Returns the number of bytes written.
+template<typename KeyType, typename Cmp, size_t MAX_DEPTH, typename NodeAlloc>
+size_t write_image(const KBTree<KeyType, Cmp, MAX_DEPTH, NodeAlloc> &tree, std::FILE *fp) {
+    using tree_t = KBTree<KeyType, Cmp, MAX_DEPTH, NodeAlloc>;
+    using node_t = typename tree_t::node_t;
+    using key_t  = KeyType;
+    static_assert(std::is_trivially_copyable<key_t>::value, "Only trivially copyable keys can be written to an image.");
+    static_assert(alignof(key_t) <= IMAGE_ALIGN, "Key alignment exceeds image alignment.");
+    // Breadth-first order keeps the upper levels together at the front of the file.
+    std::vector<node_t *> order{tree.root};
+    std::vector<uint64_t> offsets;
+    uint64_t off = detail::image_align(sizeof(image_header_t));
+    for(size_t i = 0; i < order.size(); ++i) {
+        node_t *x = order[i];
+        offsets.push_back(off);
+        off += detail::image_node_size<key_t>(x->is_internal, x->n);
+        if(x->is_internal)
+            for(int j = 0; j <= x->n; order.push_back(tree.ptr(x)[j++]));
+    }
+    image_header_t hdr{IMAGE_MAGIC, IMAGE_VERSION, uint32_t(sizeof(key_t)), uint64_t(tree.size()), uint64_t(order.size()), offsets[0], off};
+    std::vector<char> buf(detail::image_align(sizeof(image_header_t)));
+    std::memcpy(buf.data(), &hdr, sizeof(hdr));
+    if(std::fwrite(buf.data(), 1, buf.size(), fp) != buf.size()) throw std::runtime_error("Failed to write image header.");
+    size_t child = 1; // Index in order of the first child of the next internal node.
+    for(size_t i = 0; i < order.size(); ++i) {
+        node_t *x = order[i];
+        const size_t nbytes = detail::image_node_size<key_t>(x->is_internal, x->n);
+        buf.assign(nbytes, 0);
+        const uint32_t meta[2] {uint32_t(x->is_internal ? 1: 0), uint32_t(x->n)};
+        std::memcpy(buf.data(), meta, sizeof(meta));
+        std::memcpy(buf.data() + detail::image_key_offset<key_t>(), tree_t::key(x), x->n * sizeof(key_t));
+        if(x->is_internal) {
+            uint64_t *children = reinterpret_cast<uint64_t *>(buf.data() + detail::image_child_offset<key_t>(x->n));
+            for(int j = 0; j <= x->n; children[j++] = offsets[child++]);
+        }
+        if(std::fwrite(buf.data(), 1, nbytes, fp) != nbytes) throw std::runtime_error("Failed to write image node.");
+    }
+    return off;
+}
+
+template<typename KeyType, typename Cmp, size_t MAX_DEPTH, typename NodeAlloc>
+size_t write_image(const KBTree<KeyType, Cmp, MAX_DEPTH, NodeAlloc> &tree, const char *path) {
+    std::FILE *fp = std::fopen(path, "wb");
+    if(fp == nullptr) throw std::runtime_error(std::string("Could not open ") + path + " for writing.");
+    size_t ret;
+    try {
+        ret = write_image(tree, fp);
+    } catch(...) {
+        std::fclose(fp);
+        throw;
+    }
+    if(std::fclose(fp)) throw std::runtime_error(std::string("Could not close ") + path);
+    return ret;
+}
+
+template<typename KeyType, typename Cmp=DefaultCmp, size_t MAX_DEPTH_PARAM=64>
+class KBView {
+    static_assert(std::is_trivially_copyable<KeyType>::value, "KBView requires trivially copyable keys.");
+public:
+    using key_t = KeyType;
+    static constexpr size_t MAX_DEPTH = MAX_DEPTH_PARAM;
+private:
+    const char *data_;
+    size_t size_;
+    bool mapped_;
+    const image_header_t *hdr_;
+
+    struct node_t {uint32_t is_internal, n;};
+    const node_t *node(uint64_t off) const {
+        const uint64_t end = hdr_->image_size;
+        if(off % IMAGE_ALIGN || off < sizeof(image_header_t) || off > end || end - off < sizeof(node_t))
+            throw std::runtime_error("Corrupt image: node offset " + std::to_string(off) + " is out of bounds.");
+        const node_t *x = reinterpret_cast<const node_t *>(data_ + off);
+        if(x->n > end || detail::image_node_size<key_t>(x->is_internal, x->n) > end - off)
+            throw std::runtime_error("Corrupt image: node at offset " + std::to_string(off) + " overruns the image.");
+        return x;
+    }
+    static void check_depth(size_t depth) {
+        if(depth >= MAX_DEPTH) throw std::runtime_error("Corrupt image: tree deeper than MAX_DEPTH.");
+    }
+    static const key_t *key(const node_t *x) {
+        return reinterpret_cast<const key_t *>(reinterpret_cast<const char *>(x) + detail::image_key_offset<key_t>());
+    }
+    static const uint64_t *children(const node_t *x) {
+        return reinterpret_cast<const uint64_t *>(reinterpret_cast<const char *>(x) + detail::image_child_offset<key_t>(x->n));
+    }
+    // Returns the number of keys <= *k, which is also the child to descend into.
+    // *r is 0 if the last of those keys equals *k.
+    static uint32_t get_aux(const node_t *x, const key_t *k, int *r) {
+        uint32_t begin = 0, end = x->n;
+        while(begin < end) {
+            const uint32_t mid = begin + ((end - begin) >> 1);
+            if(Cmp()(key(x)[mid], *k) < 0) begin = mid + 1;
+            else end = mid;
+        }
+        if(begin == x->n) {*r = 1; return begin;}
+        *r = Cmp()(*k, key(x)[begin]);
+        return begin + (*r == 0);
+    }
+    void validate() {
+        if(reinterpret_cast<uintptr_t>(data_) % IMAGE_ALIGN)
+            throw std::runtime_error("Image buffer is not " + std::to_string(IMAGE_ALIGN) + "-byte aligned.");
+        if(size_ < sizeof(image_header_t)) throw std::runtime_error("Image is too small to contain a header.");
+        hdr_ = reinterpret_cast<const image_header_t *>(data_);
+        if(hdr_->magic != IMAGE_MAGIC)      throw std::runtime_error("Bad image magic.");
+        if(hdr_->version != IMAGE_VERSION)  throw std::runtime_error("Unsupported image version " + std::to_string(hdr_->version));
+        if(hdr_->key_size != sizeof(key_t)) throw std::runtime_error("Image key size " + std::to_string(hdr_->key_size) + " does not match " + std::to_string(sizeof(key_t)));
+        if(hdr_->image_size > size_)        throw std::runtime_error("Image is truncated.");
+        node(hdr_->root_off);
+    }
+    void unmap() {
+        if(mapped_ && data_) ::munmap(const_cast<char *>(data_), size_);
+        data_ = nullptr; mapped_ = false;
+    }
+public:
+    // View an image already in memory. The buffer must outlive the view and be IMAGE_ALIGN-aligned.
+    KBView(const void *data, size_t size): data_(static_cast<const char *>(data)), size_(size), mapped_(false), hdr_(nullptr) {
+        validate();
+    }
+    KBView(const char *path): data_(nullptr), size_(0), mapped_(false), hdr_(nullptr) {
+        const int fd = ::open(path, O_RDONLY);
+        if(fd < 0) throw std::runtime_error(std::string("Could not open ") + path);
+        struct stat st;
+        if(::fstat(fd, &st)) {::close(fd); throw std::runtime_error(std::string("Could not stat ") + path);}
+        size_ = st.st_size;
+        void *p = size_ ? ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0): MAP_FAILED;
+        ::close(fd);
+        if(p == MAP_FAILED) throw std::runtime_error(std::string("Could not mmap ") + path);
+        data_ = static_cast<const char *>(p);
+        mapped_ = true;
+        try {
+            validate();
+        } catch(...) {
+            unmap();
+            throw;
+        }
+    }
+    KBView(const KBView &) = delete;
+    KBView &operator=(const KBView &) = delete;
+    KBView(KBView &&o): data_(o.data_), size_(o.size_), mapped_(o.mapped_), hdr_(o.hdr_) {
+        o.data_ = nullptr; o.mapped_ = false;
+    }
+    ~KBView() {unmap();}
+
+    size_t size()    const {return hdr_->n_keys;}
+    size_t n_nodes() const {return hdr_->n_nodes;}
+
+    const key_t *get(const key_t *k) const {
+        int r;
+        const node_t *x = node(hdr_->root_off);
+        for(size_t depth = 0;; check_depth(++depth)) {
+            const uint32_t i = get_aux(x, k, &r);
+            if(i && r == 0) return &key(x)[i - 1];
+            if(x->is_internal == 0) return nullptr;
+            x = node(children(x)[i]);
+        }
+    }
+    const key_t *get(const key_t &k) const {return get(&k);}
+
+    void interval(const key_t *k, const key_t **lower, const key_t **upper) const {
+        int r;
+        const node_t *x = node(hdr_->root_off);
+        *lower = *upper = nullptr;
+        for(size_t depth = 0;; check_depth(++depth)) {
+            const uint32_t i = get_aux(x, k, &r);
+            if(i && r == 0) {
+                *lower = *upper = &key(x)[i - 1];
+                return;
+            }
+            if(i) *lower = &key(x)[i - 1];
+            if(i < x->n) *upper = &key(x)[i];
+            if(x->is_internal == 0) return;
+            x = node(children(x)[i]);
+        }
+    }
+    void interval(const key_t &k, const key_t **lower, const key_t **upper) const {interval(&k, lower, upper);}
+
+    // In-order traversal, yielding pointers into the image.
+    class iter_t {
+        struct pos_t {const node_t *x; unsigned i;};
+        const KBView &ref_;
+        pos_t stack_[MAX_DEPTH];
+        int top_;
+        void descend(const node_t *x) {
+            for(;;) {
+                check_depth(top_ + 1);
+                stack_[++top_] = pos_t{x, 0};
+                if(!x->is_internal) break;
+                x = ref_.node(children(x)[0]);
+            }
+        }
+        void settle() {
+            // Pop exhausted nodes until the top of the stack points at a key.
+            while(top_ >= 0 && stack_[top_].i >= stack_[top_].x->n) --top_;
+        }
+    public:
+        iter_t(const KBView &ref): ref_(ref), top_(-1) {
+            descend(ref_.node(ref_.hdr_->root_off));
+            settle();
+        }
+        bool valid() const {return top_ >= 0;}
+        const key_t &key() const {return KBView::key(stack_[top_].x)[stack_[top_].i];}
+        void next() {
+            pos_t &p = stack_[top_];
+            const unsigned i = p.i++;
+            if(p.x->is_internal) descend(ref_.node(children(p.x)[i + 1]));
+            settle();
+        }
+    };
+    iter_t begin_iter() const {return iter_t(*this);}
+    template<typename Func>
+    void for_each(const Func &func) const {
+        for(iter_t it(*this); it.valid(); it.next()) func(it.key());
+    }
+};
+
+} // namespace kb
+
+#endif
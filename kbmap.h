@@ -0,0 +1,258 @@
+#ifndef KBTREE_MAP_H__
+#define KBTREE_MAP_H__
+#include "kb.h"
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Ordered key-value map in the style of kb::KBTree.
+ * Internal nodes hold separator keys only; leaves hold keys packed contiguously
+ * for search and values in a parallel array, so a lookup touches the value's
+ * cache line once at the end. Keys and values are constructed, moved and
+ * destroyed properly, so neither needs to be trivially copyable.
+ * Keys must be copy-constructible (separators are copies) and values must be
+ * move-constructible. Leaves are not merged on erase.
+ */
+
+namespace kb {
+
+template<typename KeyType, typename ValueType, typename Cmp=DefaultCmp, size_t NODE_BYTES=KB_DEFAULT_SIZE, typename NodeAlloc=SlabNodeAlloc>
+class KBMap {
+public:
+    using key_t    = KeyType;
+    using mapped_t = ValueType;
+    using alloc_t  = NodeAlloc;
+
+    struct node_t {int32_t is_internal, n;};
+    static constexpr unsigned LEAF_N  = std::max<size_t>(4, (NODE_BYTES - sizeof(node_t) - sizeof(void *)) / (sizeof(key_t) + sizeof(mapped_t)));
+    static constexpr unsigned INNER_N = std::max<size_t>(4, (NODE_BYTES - sizeof(node_t) - sizeof(void *)) / (sizeof(key_t) + sizeof(void *)));
+    struct leaf_t: node_t {
+        leaf_t *next;
+        alignas(key_t)    unsigned char kbuf[LEAF_N * sizeof(key_t)];
+        alignas(mapped_t) unsigned char vbuf[LEAF_N * sizeof(mapped_t)];
+        key_t    *keys() {return reinterpret_cast<key_t *>(kbuf);}
+        mapped_t *vals() {return reinterpret_cast<mapped_t *>(vbuf);}
+        const key_t    *keys() const {return reinterpret_cast<const key_t *>(kbuf);}
+        const mapped_t *vals() const {return reinterpret_cast<const mapped_t *>(vbuf);}
+    };
+    struct inner_t: node_t {
+        // n separators and n + 1 children; keys()[i] is >= every key under children[i].
+        node_t *children[INNER_N + 1];
+        alignas(key_t) unsigned char kbuf[INNER_N * sizeof(key_t)];
+        key_t       *keys()       {return reinterpret_cast<key_t *>(kbuf);}
+        const key_t *keys() const {return reinterpret_cast<const key_t *>(kbuf);}
+    };
+
+private:
+    alloc_t alloc_;
+    node_t *root_;
+    size_t n_keys_;
+
+    // Move n objects from src to dst (which may overlap), ending the lifetime of the sources.
+    template<typename T>
+    static void relocate(T *dst, T *src, size_t n) {
+        if(std::is_trivially_copyable<T>::value) {
+            std::memmove(static_cast<void *>(dst), static_cast<const void *>(src), n * sizeof(T));
+        } else if(dst < src) {
+            for(size_t i = 0; i < n; ++i) {new(dst + i) T(std::move(src[i])); src[i].~T();}
+        } else if(dst > src) {
+            for(size_t i = n; i--;)       {new(dst + i) T(std::move(src[i])); src[i].~T();}
+        }
+    }
+    template<typename T>
+    static void destroy_n(T *p, size_t n) {
+        if(!std::is_trivially_destructible<T>::value) for(size_t i = 0; i < n; p[i++].~T());
+    }
+    static unsigned lower_bound(const key_t *keys, unsigned n, const key_t &k) {
+        unsigned lo = 0, hi = n;
+        while(lo < hi) {
+            const unsigned mid = (lo + hi) >> 1;
+            if(Cmp()(keys[mid], k) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    leaf_t *new_leaf() {
+        leaf_t *ret = static_cast<leaf_t *>(alloc_.allocate(false));
+        ret->is_internal = 0; ret->n = 0; ret->next = nullptr;
+        return ret;
+    }
+    inner_t *new_inner() {
+        inner_t *ret = static_cast<inner_t *>(alloc_.allocate(true));
+        ret->is_internal = 1; ret->n = 0;
+        return ret;
+    }
+    bool is_full(const node_t *x) const {return x->n == int(x->is_internal ? INNER_N: LEAF_N);}
+    // Split the full child p->children[i], inserting its separator into p, which is not full.
+    void split_child(inner_t *p, unsigned i) {
+        node_t *c = p->children[i], *right;
+        key_t *sep;
+        KSTAT_ADD(kb_splits, 1);
+        if(c->is_internal) {
+            inner_t *x = static_cast<inner_t *>(c), *y = new_inner();
+            const unsigned mid = x->n >> 1;
+            y->n = x->n - mid - 1;
+            relocate(y->keys(), x->keys() + mid + 1, y->n);
+            std::memcpy(y->children, x->children + mid + 1, sizeof(node_t *) * (y->n + 1));
+            sep = x->keys() + mid;
+            x->n = mid;
+            right = y;
+        } else {
+            leaf_t *x = static_cast<leaf_t *>(c), *y = new_leaf();
+            const unsigned mid = (x->n + 1) >> 1;
+            y->n = x->n - mid;
+            relocate(y->keys(), x->keys() + mid, y->n);
+            relocate(y->vals(), x->vals() + mid, y->n);
+            x->n = mid;
+            y->next = x->next;
+            x->next = y;
+            sep = x->keys() + mid - 1;
+            right = y;
+        }
+        relocate(p->keys() + i + 1, p->keys() + i, p->n - i);
+        std::memmove(p->children + i + 2, p->children + i + 1, sizeof(node_t *) * (p->n - i));
+        if(c->is_internal) {
+            // The middle separator moves up.
+            new(p->keys() + i) key_t(std::move(*sep));
+            sep->~key_t();
+        } else {
+            new(p->keys() + i) key_t(*sep);
+        }
+        p->children[i + 1] = right;
+        ++p->n;
+    }
+    // Descend to the leaf which should hold k, splitting full nodes on the way.
+    leaf_t *descend_for_insert(const key_t &k) {
+        if(is_full(root_)) {
+            inner_t *s = new_inner();
+            s->children[0] = root_;
+            root_ = s;
+            split_child(s, 0);
+        }
+        node_t *x = root_;
+        KSTAT_ADD(kb_puts, 1);
+        while(x->is_internal) {
+            inner_t *inner = static_cast<inner_t *>(x);
+            unsigned i = lower_bound(inner->keys(), inner->n, k);
+            KSTAT_ADD(kb_put_depth, 1);
+            if(is_full(inner->children[i])) {
+                split_child(inner, i);
+                i += Cmp()(k, inner->keys()[i]) > 0;
+            }
+            x = inner->children[i];
+        }
+        return static_cast<leaf_t *>(x);
+    }
+    leaf_t *find_leaf(const key_t &k) const {
+        node_t *x = root_;
+        while(x->is_internal) {
+            const inner_t *inner = static_cast<const inner_t *>(x);
+            x = inner->children[lower_bound(inner->keys(), inner->n, k)];
+        }
+        return static_cast<leaf_t *>(x);
+    }
+    leaf_t *first_leaf() const {
+        node_t *x = root_;
+        while(x->is_internal) x = static_cast<inner_t *>(x)->children[0];
+        return static_cast<leaf_t *>(x);
+    }
+    void destroy(node_t *x) {
+        if(x->is_internal) {
+            inner_t *inner = static_cast<inner_t *>(x);
+            for(int i = 0; i <= inner->n; destroy(inner->children[i++]));
+            destroy_n(inner->keys(), inner->n);
+        } else {
+            leaf_t *leaf = static_cast<leaf_t *>(x);
+            destroy_n(leaf->keys(), leaf->n);
+            destroy_n(leaf->vals(), leaf->n);
+        }
+        if(!alloc_t::bulk_release) alloc_.deallocate(x, x->is_internal);
+    }
+    void destroy_all() {
+        if(root_ == nullptr) return;
+        if(!alloc_t::bulk_release || !std::is_trivially_destructible<key_t>::value || !std::is_trivially_destructible<mapped_t>::value)
+            destroy(root_);
+        alloc_.release();
+        root_ = nullptr;
+        n_keys_ = 0;
+    }
+
+public:
+    KBMap(): alloc_(sizeof(inner_t), sizeof(leaf_t)), root_(nullptr), n_keys_(0) {
+        root_ = new_leaf();
+    }
+    KBMap(const KBMap &) = delete;
+    KBMap &operator=(const KBMap &) = delete;
+    ~KBMap() {destroy_all();}
+
+    size_t size() const {return n_keys_;}
+    bool empty()  const {return n_keys_ == 0;}
+    void clear() {
+        destroy_all();
+        root_ = new_leaf();
+    }
+
+    mapped_t *find(const key_t &k) {
+        leaf_t *leaf = find_leaf(k);
+        const unsigned i = lower_bound(leaf->keys(), leaf->n, k);
+        return i < unsigned(leaf->n) && Cmp()(leaf->keys()[i], k) == 0 ? leaf->vals() + i: nullptr;
+    }
+    const mapped_t *find(const key_t &k) const {return const_cast<KBMap *>(this)->find(k);}
+    bool contains(const key_t &k) const {return find(k) != nullptr;}
+
+    // Constructs a value from args only if k is absent. Returns the stored value and whether it was inserted.
+    template<typename... Args>
+    std::pair<mapped_t *, bool> try_emplace(const key_t &k, Args &&... args) {
+        leaf_t *leaf = descend_for_insert(k);
+        const unsigned i = lower_bound(leaf->keys(), leaf->n, k);
+        if(i < unsigned(leaf->n) && Cmp()(leaf->keys()[i], k) == 0) return {leaf->vals() + i, false};
+        mapped_t tmp(std::forward<Args>(args)...);
+        key_t ktmp(k);
+        relocate(leaf->keys() + i + 1, leaf->keys() + i, leaf->n - i);
+        relocate(leaf->vals() + i + 1, leaf->vals() + i, leaf->n - i);
+        new(leaf->keys() + i) key_t(std::move(ktmp));
+        new(leaf->vals() + i) mapped_t(std::move(tmp));
+        ++leaf->n;
+        ++n_keys_;
+        return {leaf->vals() + i, true};
+    }
+    template<typename M>
+    std::pair<mapped_t *, bool> insert_or_assign(const key_t &k, M &&obj) {
+        auto ret = try_emplace(k, std::forward<M>(obj));
+        if(!ret.second) *ret.first = std::forward<M>(obj);
+        return ret;
+    }
+    mapped_t &operator[](const key_t &k) {return *try_emplace(k).first;}
+
+    // Returns the number of elements removed.
+    size_t erase(const key_t &k) {
+        leaf_t *leaf = find_leaf(k);
+        const unsigned i = lower_bound(leaf->keys(), leaf->n, k);
+        if(i == unsigned(leaf->n) || Cmp()(leaf->keys()[i], k) != 0) return 0;
+        leaf->keys()[i].~key_t();
+        leaf->vals()[i].~mapped_t();
+        relocate(leaf->keys() + i, leaf->keys() + i + 1, leaf->n - i - 1);
+        relocate(leaf->vals() + i, leaf->vals() + i + 1, leaf->n - i - 1);
+        --leaf->n;
+        --n_keys_;
+        return 1;
+    }
+
+    // In-order traversal; func is called as func(const key_t &, mapped_t &).
+    template<typename Func>
+    void for_each(const Func &func) {
+        for(leaf_t *leaf = first_leaf(); leaf; leaf = leaf->next)
+            for(int i = 0; i < leaf->n; ++i) func(leaf->keys()[i], leaf->vals()[i]);
+    }
+    template<typename Func>
+    void for_each(const Func &func) const {
+        for(const leaf_t *leaf = first_leaf(); leaf; leaf = leaf->next)
+            for(int i = 0; i < leaf->n; ++i) func(leaf->keys()[i], leaf->vals()[i]);
+    }
+};
+
+} // namespace kb
+
+#endif
@@ -0,0 +1,513 @@
+#ifndef KBTREE_OLC_H__
+#define KBTREE_OLC_H__
+#include "kb.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Concurrent, read-mostly B+-tree using optimistic lock coupling (Leis et al., 2016).
+ * Every node carries a version word. Readers record the version on the way down
+ * and validate it afterwards, restarting on conflict, so lookups never write to
+ * shared nodes. Writers upgrade to exclusive locks only on the node they modify
+ * and, for splits, its parent.
+ * Leaves emptied by erase() are unlinked and handed to an epoch-based reclaimer.
+ * Inner nodes are never merged or freed while the tree is live: unlinking a leaf
+ * only drops its separator, so an inner node can shrink to one child but stays
+ * in place until the tree is destroyed. Trees which permanently lose most of
+ * their keys should be rebuilt.
+ * Keys are read racily and validated, so they must be trivially copyable.
+ */
+
+namespace kb {
+
+class EpochManager;
+
+namespace detail {
+static constexpr unsigned EPOCH_MAX_THREADS = 256;
+inline std::atomic<uint64_t> epoch_tid_bits[EPOCH_MAX_THREADS / 64];
+
+// Live managers, so that an exiting thread can hand its retired nodes over.
+struct epoch_registry_t {
+    std::mutex lock;
+    std::vector<EpochManager *> managers;
+};
+inline epoch_registry_t &epoch_registry() {
+    static epoch_registry_t ret;
+    return ret;
+}
+
+struct EpochThreadId {
+    // Process-wide small integer id for the calling thread, at most EPOCH_MAX_THREADS
+    // at once. On thread exit its slots are released and the id is recycled.
+    unsigned id;
+    EpochThreadId() {
+        for(unsigned i = 0; i < EPOCH_MAX_THREADS / 64; ++i) {
+            uint64_t bits = epoch_tid_bits[i].load(std::memory_order_relaxed);
+            while(~bits) {
+                const unsigned bit = __builtin_ctzll(~bits);
+                if(epoch_tid_bits[i].compare_exchange_weak(bits, bits | (uint64_t(1) << bit), std::memory_order_acquire)) {
+                    id = i * 64 + bit;
+                    return;
+                }
+            }
+        }
+        throw std::runtime_error("Too many threads registered with kb::EpochManager. Max: " + std::to_string(EPOCH_MAX_THREADS));
+    }
+    ~EpochThreadId();
+};
+inline unsigned epoch_thread_id() {
+    static thread_local EpochThreadId tid;
+    return tid.id;
+}
+} // namespace detail
+
+class EpochManager {
+    static constexpr uint64_t IDLE = uint64_t(-1);
+    static constexpr size_t RECLAIM_INTERVAL = 64;
+    struct retired_t {void *p; void (*deleter)(void *); uint64_t epoch;};
+    struct alignas(64) slot_t {
+        std::atomic<uint64_t> epoch{IDLE};
+        unsigned depth = 0;
+        std::vector<retired_t> retired;
+    };
+    alignas(64) std::atomic<uint64_t> global_;
+    slot_t slots_[detail::EPOCH_MAX_THREADS];
+    // Retired nodes left behind by exited threads, reclaimed by whichever thread gets the lock.
+    std::mutex orphan_lock_;
+    std::vector<retired_t> orphans_;
+    friend struct detail::EpochThreadId;
+
+    uint64_t min_active() const {
+        uint64_t ret = IDLE;
+        for(const auto &slot: slots_) ret = std::min(ret, slot.epoch.load(std::memory_order_acquire));
+        return ret;
+    }
+    void reclaim(slot_t &slot) {
+        global_.fetch_add(1, std::memory_order_acq_rel);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const uint64_t safe = min_active();
+        free_before(slot.retired, safe);
+        std::unique_lock<std::mutex> lock(orphan_lock_, std::try_to_lock);
+        if(lock) free_before(orphans_, safe);
+    }
+    static void free_before(std::vector<retired_t> &retired, uint64_t safe) {
+        auto keep = std::partition(retired.begin(), retired.end(), [safe](const retired_t &r) {return r.epoch >= safe;});
+        for(auto it = keep; it != retired.end(); ++it) it->deleter(it->p);
+        retired.erase(keep, retired.end());
+    }
+    // Called on exit of the thread owning slots_[id], which no other thread touches until the id is reused.
+    void release_thread(unsigned id) {
+        slot_t &slot = slots_[id];
+        if(slot.retired.empty()) return;
+        std::lock_guard<std::mutex> lock(orphan_lock_);
+        orphans_.insert(orphans_.end(), slot.retired.begin(), slot.retired.end());
+        std::vector<retired_t>().swap(slot.retired);
+    }
+public:
+    class Guard {
+        EpochManager &m_;
+        slot_t &slot_;
+    public:
+        Guard(EpochManager &m): m_(m), slot_(m.slots_[detail::epoch_thread_id()]) {
+            if(slot_.depth++ == 0) {
+                slot_.epoch.store(m_.global_.load(std::memory_order_acquire), std::memory_order_seq_cst);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+        ~Guard() {
+            if(--slot_.depth == 0) slot_.epoch.store(IDLE, std::memory_order_release);
+        }
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+    };
+
+    EpochManager(): global_(0) {
+        auto &reg = detail::epoch_registry();
+        std::lock_guard<std::mutex> lock(reg.lock);
+        reg.managers.push_back(this);
+    }
+    EpochManager(const EpochManager &) = delete;
+    EpochManager &operator=(const EpochManager &) = delete;
+    // Must be called after p has been unlinked from all shared structures.
+    void retire(void *p, void (*deleter)(void *)) {
+        slot_t &slot = slots_[detail::epoch_thread_id()];
+        slot.retired.push_back(retired_t{p, deleter, global_.load(std::memory_order_acquire)});
+        if(slot.retired.size() % RECLAIM_INTERVAL == 0) reclaim(slot);
+    }
+    ~EpochManager() {
+        {
+            auto &reg = detail::epoch_registry();
+            std::lock_guard<std::mutex> lock(reg.lock);
+            reg.managers.erase(std::find(reg.managers.begin(), reg.managers.end(), this));
+        }
+        for(auto &slot: slots_)
+            for(const auto &r: slot.retired) r.deleter(r.p);
+        for(const auto &r: orphans_) r.deleter(r.p);
+    }
+};
+
+inline detail::EpochThreadId::~EpochThreadId() {
+    {
+        auto &reg = epoch_registry();
+        std::lock_guard<std::mutex> lock(reg.lock);
+        for(EpochManager *m: reg.managers) m->release_thread(id);
+    }
+    epoch_tid_bits[id / 64].fetch_and(~(uint64_t(1) << (id % 64)), std::memory_order_release);
+}
+
+template<typename KeyType, typename Cmp=DefaultCmp, size_t NODE_BYTES=KB_DEFAULT_SIZE>
+class OLCTree {
+    static_assert(std::is_trivially_copyable<KeyType>::value, "OLCTree keys are read optimistically and must be trivially copyable.");
+public:
+    using key_t = KeyType;
+
+    struct node_t {
+        // version: bit 0 is obsolete, bit 1 is locked, the rest is a counter.
+        std::atomic<uint64_t> version;
+        uint16_t count;
+        bool is_leaf;
+        node_t(bool leaf): version(0b100), count(0), is_leaf(leaf) {}
+
+        static bool is_locked(uint64_t v)   {return v & 0b10;}
+        static bool is_obsolete(uint64_t v) {return v & 0b01;}
+        uint64_t read_lock_or_restart(bool &restart) const {
+            uint64_t v = version.load(std::memory_order_acquire);
+            if(is_locked(v) || is_obsolete(v)) restart = true;
+            return v;
+        }
+        void check_or_restart(uint64_t v, bool &restart) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(v != version.load(std::memory_order_relaxed)) restart = true;
+        }
+        void read_unlock_or_restart(uint64_t v, bool &restart) const {check_or_restart(v, restart);}
+        void upgrade_to_write_lock_or_restart(uint64_t &v, bool &restart) {
+            if(version.compare_exchange_strong(v, v + 0b10, std::memory_order_acquire)) v += 0b10;
+            else restart = true;
+        }
+        void write_unlock()          {version.fetch_add(0b10, std::memory_order_release);}
+        void write_unlock_obsolete() {version.fetch_add(0b11, std::memory_order_release);}
+    };
+    static constexpr size_t HEADER = (sizeof(node_t) + alignof(key_t) - 1) / alignof(key_t) * alignof(key_t);
+    static constexpr unsigned LEAF_MAX  = (NODE_BYTES - HEADER) / sizeof(key_t);
+    static constexpr unsigned INNER_MAX = (NODE_BYTES - HEADER - sizeof(void *)) / (sizeof(key_t) + sizeof(void *));
+    static_assert(LEAF_MAX >= 4 && INNER_MAX >= 4, "NODE_BYTES is too small for this key type.");
+
+    struct leaf_t: node_t {
+        key_t keys[LEAF_MAX];
+        leaf_t(): node_t(true) {}
+        bool is_full() const {return this->count == LEAF_MAX;}
+        leaf_t *split(key_t &sep) {
+            leaf_t *ret = new leaf_t;
+            ret->count = this->count - (this->count / 2);
+            this->count -= ret->count;
+            std::memcpy(ret->keys, keys + this->count, sizeof(key_t) * ret->count);
+            sep = keys[this->count - 1];
+            return ret;
+        }
+    };
+    struct inner_t: node_t {
+        // count keys separate count + 1 children; keys[i] is the largest key under children[i].
+        key_t keys[INNER_MAX];
+        node_t *children[INNER_MAX + 1];
+        inner_t(): node_t(false) {}
+        bool is_full() const {return this->count == INNER_MAX - 1;}
+        inner_t *split(key_t &sep) {
+            inner_t *ret = new inner_t;
+            ret->count = this->count - (this->count / 2);
+            this->count = this->count - ret->count - 1;
+            sep = keys[this->count];
+            std::memcpy(ret->keys, keys + this->count + 1, sizeof(key_t) * ret->count);
+            std::memcpy(ret->children, children + this->count + 1, sizeof(node_t *) * (ret->count + 1));
+            return ret;
+        }
+        void insert(const key_t &k, node_t *child) {
+            const unsigned pos = lower_bound(keys, this->count, k);
+            std::memmove(keys + pos + 1, keys + pos, sizeof(key_t) * (this->count - pos));
+            std::memmove(children + pos + 1, children + pos, sizeof(node_t *) * (this->count - pos + 1));
+            keys[pos] = k;
+            children[pos] = children[pos + 1];
+            children[pos + 1] = child;
+            ++this->count;
+        }
+        void remove_child(unsigned pos) {
+            // Drop children[pos]; its key range is absorbed by a neighbour.
+            const unsigned kpos = pos < this->count ? pos: pos - 1;
+            std::memmove(keys + kpos, keys + kpos + 1, sizeof(key_t) * (this->count - kpos - 1));
+            std::memmove(children + pos, children + pos + 1, sizeof(node_t *) * (this->count - pos));
+            --this->count;
+        }
+    };
+
+private:
+    std::atomic<node_t *> root_;
+    mutable EpochManager epoch_;
+
+    static unsigned lower_bound(const key_t *keys, unsigned count, const key_t &k) {
+        unsigned lo = 0, hi = count;
+        while(lo < hi) {
+            const unsigned mid = (lo + hi) >> 1;
+            if(Cmp()(keys[mid], k) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    // Restarts are bounded in practice; yield if a writer holds us up for long.
+    static void backoff(unsigned &nrestarts) {
+        if(++nrestarts % 64 == 0) std::this_thread::yield();
+    }
+    void make_root(const key_t &sep, node_t *left, node_t *right) {
+        inner_t *inner = new inner_t;
+        inner->count = 1;
+        inner->keys[0] = sep;
+        inner->children[0] = left;
+        inner->children[1] = right;
+        root_.store(inner, std::memory_order_release);
+    }
+    static void free_node(void *p) {
+        node_t *x = static_cast<node_t *>(p);
+        if(x->is_leaf) delete static_cast<leaf_t *>(x);
+        else           delete static_cast<inner_t *>(x);
+    }
+    void destroy(node_t *x) {
+        if(!x->is_leaf) {
+            inner_t *inner = static_cast<inner_t *>(x);
+            for(unsigned i = 0; i <= inner->count; ++i) destroy(inner->children[i]);
+        }
+        free_node(x);
+    }
+
+public:
+    OLCTree(): root_(new leaf_t) {}
+    OLCTree(const OLCTree &) = delete;
+    OLCTree &operator=(const OLCTree &) = delete;
+    ~OLCTree() {destroy(root_.load(std::memory_order_relaxed));}
+
+    // Copies the stored key equal to k into *out, if present.
+    bool get(const key_t &k, key_t *out=nullptr) const {
+        EpochManager::Guard guard(epoch_);
+        unsigned nrestarts = 0;
+    restart:
+        bool restart = false;
+        node_t *node = root_.load(std::memory_order_acquire);
+        uint64_t v = node->read_lock_or_restart(restart);
+        if(restart || node != root_.load(std::memory_order_acquire)) {backoff(nrestarts); goto restart;}
+        const node_t *parent = nullptr;
+        uint64_t vparent = 0;
+        while(!node->is_leaf) {
+            const inner_t *inner = static_cast<const inner_t *>(node);
+            if(parent) {
+                parent->read_unlock_or_restart(vparent, restart);
+                if(restart) {backoff(nrestarts); goto restart;}
+            }
+            parent = inner;
+            vparent = v;
+            node = inner->children[lower_bound(inner->keys, inner->count, k)];
+            inner->check_or_restart(v, restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+            v = node->read_lock_or_restart(restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+        }
+        const leaf_t *leaf = static_cast<const leaf_t *>(node);
+        const unsigned pos = lower_bound(leaf->keys, leaf->count, k);
+        key_t found = k;
+        const bool ret = pos < leaf->count && Cmp()(leaf->keys[pos], k) == 0;
+        if(ret) found = leaf->keys[pos];
+        if(parent) {
+            parent->read_unlock_or_restart(vparent, restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+        }
+        node->read_unlock_or_restart(v, restart);
+        if(restart) {backoff(nrestarts); goto restart;}
+        if(ret && out) *out = found;
+        return ret;
+    }
+    bool contains(const key_t &k) const {return get(k);}
+
+    // Returns false if an equal key was already present.
+    bool insert(const key_t &k) {
+        EpochManager::Guard guard(epoch_);
+        unsigned nrestarts = 0;
+    restart:
+        bool restart = false;
+        node_t *node = root_.load(std::memory_order_acquire);
+        uint64_t v = node->read_lock_or_restart(restart);
+        if(restart || node != root_.load(std::memory_order_acquire)) {backoff(nrestarts); goto restart;}
+        inner_t *parent = nullptr;
+        uint64_t vparent = 0;
+        while(!node->is_leaf) {
+            inner_t *inner = static_cast<inner_t *>(node);
+            if(inner->is_full()) {
+                // Split eagerly so that the parent always has room for a separator.
+                if(parent) {
+                    parent->upgrade_to_write_lock_or_restart(vparent, restart);
+                    if(restart) {backoff(nrestarts); goto restart;}
+                }
+                node->upgrade_to_write_lock_or_restart(v, restart);
+                if(restart) {
+                    if(parent) parent->write_unlock();
+                    backoff(nrestarts); goto restart;
+                }
+                if(!parent && node != root_.load(std::memory_order_acquire)) {
+                    node->write_unlock();
+                    backoff(nrestarts); goto restart;
+                }
+                key_t sep;
+                inner_t *sibling = inner->split(sep);
+                if(parent) parent->insert(sep, sibling);
+                else       make_root(sep, inner, sibling);
+                node->write_unlock();
+                if(parent) parent->write_unlock();
+                goto restart;
+            }
+            if(parent) {
+                parent->read_unlock_or_restart(vparent, restart);
+                if(restart) {backoff(nrestarts); goto restart;}
+            }
+            parent = inner;
+            vparent = v;
+            node = inner->children[lower_bound(inner->keys, inner->count, k)];
+            inner->check_or_restart(v, restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+            v = node->read_lock_or_restart(restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+        }
+        leaf_t *leaf = static_cast<leaf_t *>(node);
+        if(leaf->is_full()) {
+            if(parent) {
+                parent->upgrade_to_write_lock_or_restart(vparent, restart);
+                if(restart) {backoff(nrestarts); goto restart;}
+            }
+            node->upgrade_to_write_lock_or_restart(v, restart);
+            if(restart) {
+                if(parent) parent->write_unlock();
+                backoff(nrestarts); goto restart;
+            }
+            if(!parent && node != root_.load(std::memory_order_acquire)) {
+                node->write_unlock();
+                backoff(nrestarts); goto restart;
+            }
+            key_t sep;
+            leaf_t *sibling = leaf->split(sep);
+            if(parent) parent->insert(sep, sibling);
+            else       make_root(sep, leaf, sibling);
+            node->write_unlock();
+            if(parent) parent->write_unlock();
+            goto restart;
+        }
+        node->upgrade_to_write_lock_or_restart(v, restart);
+        if(restart) {backoff(nrestarts); goto restart;}
+        if(parent) {
+            parent->read_unlock_or_restart(vparent, restart);
+            if(restart) {
+                node->write_unlock();
+                backoff(nrestarts); goto restart;
+            }
+        }
+        const unsigned pos = lower_bound(leaf->keys, leaf->count, k);
+        if(pos < leaf->count && Cmp()(leaf->keys[pos], k) == 0) {
+            node->write_unlock();
+            return false;
+        }
+        std::memmove(leaf->keys + pos + 1, leaf->keys + pos, sizeof(key_t) * (leaf->count - pos));
+        leaf->keys[pos] = k;
+        ++leaf->count;
+        node->write_unlock();
+        return true;
+    }
+
+    // Returns false if k was not present. Leaves are not merged, but a leaf
+    // losing its last key is unlinked from its parent and retired.
+    bool erase(const key_t &k) {
+        EpochManager::Guard guard(epoch_);
+        unsigned nrestarts = 0;
+    restart:
+        bool restart = false;
+        node_t *node = root_.load(std::memory_order_acquire);
+        uint64_t v = node->read_lock_or_restart(restart);
+        if(restart || node != root_.load(std::memory_order_acquire)) {backoff(nrestarts); goto restart;}
+        inner_t *parent = nullptr;
+        uint64_t vparent = 0;
+        unsigned child_pos = 0;
+        while(!node->is_leaf) {
+            inner_t *inner = static_cast<inner_t *>(node);
+            if(parent) {
+                parent->read_unlock_or_restart(vparent, restart);
+                if(restart) {backoff(nrestarts); goto restart;}
+            }
+            parent = inner;
+            vparent = v;
+            child_pos = lower_bound(inner->keys, inner->count, k);
+            node = inner->children[child_pos];
+            inner->check_or_restart(v, restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+            v = node->read_lock_or_restart(restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+        }
+        leaf_t *leaf = static_cast<leaf_t *>(node);
+        const unsigned pos = lower_bound(leaf->keys, leaf->count, k);
+        const bool present = pos < leaf->count && Cmp()(leaf->keys[pos], k) == 0;
+        const bool unlink = present && leaf->count == 1 && parent && parent->count > 0;
+        if(!present) {
+            node->read_unlock_or_restart(v, restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+            return false;
+        }
+        if(unlink) {
+            parent->upgrade_to_write_lock_or_restart(vparent, restart);
+            if(restart) {backoff(nrestarts); goto restart;}
+        }
+        node->upgrade_to_write_lock_or_restart(v, restart);
+        if(restart) {
+            if(unlink) parent->write_unlock();
+            backoff(nrestarts); goto restart;
+        }
+        if(unlink) {
+            parent->remove_child(child_pos);
+            parent->write_unlock();
+            leaf->write_unlock_obsolete();
+            epoch_.retire(leaf, free_node);
+            return true;
+        }
+        if(parent) {
+            parent->read_unlock_or_restart(vparent, restart);
+            if(restart) {
+                node->write_unlock();
+                backoff(nrestarts); goto restart;
+            }
+        }
+        std::memmove(leaf->keys + pos, leaf->keys + pos + 1, sizeof(key_t) * (leaf->count - pos - 1));
+        --leaf->count;
+        node->write_unlock();
+        return true;
+    }
+
+    // Not safe against concurrent writers.
+    template<typename Func>
+    void for_each(const Func &func) const {
+        std::vector<const node_t *> stack{root_.load(std::memory_order_acquire)};
+        while(!stack.empty()) {
+            const node_t *x = stack.back();
+            stack.pop_back();
+            if(x->is_leaf) {
+                const leaf_t *leaf = static_cast<const leaf_t *>(x);
+                for(unsigned i = 0; i < leaf->count; func(leaf->keys[i++]));
+            } else {
+                const inner_t *inner = static_cast<const inner_t *>(x);
+                for(unsigned i = inner->count + 1; i--; stack.push_back(inner->children[i]));
+            }
+        }
+    }
+    // Not safe against concurrent writers.
+    size_t size() const {
+        size_t ret = 0;
+        for_each([&ret](const key_t &) {++ret;});
+        return ret;
+    }
+};
+
+} // namespace kb
+
+#endif
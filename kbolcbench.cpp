@@ -0,0 +1,67 @@
+#include "kbolc.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <vector>
+
+// Scaling benchmark for kb::OLCTree against a mutex-wrapped kb::KBTree.
+// Usage: kbolcbench [max_threads] [ops_per_thread] [prefill]
+// Emits one tab-separated line per (implementation, read percentage, thread count).
+
+struct LockedKBTree {
+    kb::KBTree<uint64_t> tree;
+    std::mutex m;
+    bool get(uint64_t k) {std::lock_guard<std::mutex> lock(m); return tree.get(k) != nullptr;}
+    void insert(uint64_t k) {
+        std::lock_guard<std::mutex> lock(m);
+        if(tree.get(k) == nullptr) tree.put(k);
+    }
+};
+struct OLC {
+    kb::OLCTree<uint64_t> tree;
+    bool get(uint64_t k) {return tree.get(k);}
+    void insert(uint64_t k) {tree.insert(k);}
+};
+
+template<typename Tree>
+double run(unsigned nthreads, unsigned read_pct, size_t nops, size_t prefill) {
+    Tree tree;
+    std::mt19937_64 mt(13);
+    // Reads draw from the prefilled keys so that they hit, as lookups of an index mostly do.
+    std::vector<uint64_t> keys(std::max<size_t>(prefill, 1));
+    for(auto &k: keys) tree.insert(k = mt());
+    std::vector<std::thread> threads;
+    std::atomic<size_t> sink(0);
+    auto start = std::chrono::high_resolution_clock::now();
+    for(unsigned tid = 0; tid < nthreads; ++tid) {
+        threads.emplace_back([&, tid] {
+            std::mt19937_64 rng(tid * 1337 + 1);
+            size_t found = 0;
+            for(size_t i = 0; i < nops; ++i) {
+                const uint64_t r = rng();
+                if(r % 100 < read_pct) found += tree.get(keys[(r >> 8) % keys.size()]);
+                else tree.insert(rng());
+            }
+            sink += found;
+        });
+    }
+    for(auto &t: threads) t.join();
+    auto stop = std::chrono::high_resolution_clock::now();
+    return double(nops) * nthreads / std::chrono::duration<double>(stop - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const unsigned max_threads = argc > 1 ? std::atoi(argv[1]): std::max(1u, std::thread::hardware_concurrency());
+    const size_t nops = argc > 2 ? std::strtoull(argv[2], nullptr, 10): 1000000;
+    const size_t prefill = argc > 3 ? std::strtoull(argv[3], nullptr, 10): 1000000;
+    std::printf("#impl\tread_pct\tthreads\tops_per_sec\n");
+    for(const unsigned read_pct: {100u, 95u, 50u}) {
+        for(unsigned nthreads = 1; nthreads <= max_threads; nthreads <<= 1) {
+            std::printf("olc\t%u\t%u\t%g\n", read_pct, nthreads, run<OLC>(nthreads, read_pct, nops, prefill));
+            std::printf("mutex\t%u\t%u\t%g\n", read_pct, nthreads, run<LockedKBTree>(nthreads, read_pct, nops, prefill));
+            std::fflush(stdout);
+        }
+    }
+}
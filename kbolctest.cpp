@@ -0,0 +1,151 @@
+#include "kbolc.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+// Small nodes, so that splits and leaf retirement happen often.
+using Tree = kb::OLCTree<uint64_t, kb::DefaultCmp, 128>;
+
+template<typename T>
+int check_contents(const T &tree, const std::set<uint64_t> &ref, const char *what) {
+    if(tree.size() != ref.size()) return std::fprintf(stderr, "%s: size mismatch: %zu vs %zu\n", what, tree.size(), ref.size());
+    auto it = ref.begin();
+    bool ordered = true;
+    tree.for_each([&](const uint64_t &k) {ordered &= (it != ref.end() && *it++ == k);});
+    if(!ordered || it != ref.end()) return std::fprintf(stderr, "%s: iteration mismatch\n", what);
+    return 0;
+}
+
+int check_single(size_t nops) {
+    Tree tree;
+    std::set<uint64_t> ref;
+    std::mt19937_64 mt(7);
+    for(size_t i = 0; i < nops; ++i) {
+        const uint64_t k = mt() % (nops / 4);
+        switch(mt() % 3) {
+            case 0: if(tree.insert(k) != ref.insert(k).second) return std::fprintf(stderr, "insert mismatch at %zu\n", size_t(k)); break;
+            case 1: if(tree.erase(k) != (ref.erase(k) != 0)) return std::fprintf(stderr, "erase mismatch at %zu\n", size_t(k)); break;
+            default: {
+                uint64_t out = ~k;
+                const bool found = tree.get(k, &out);
+                if(found != (ref.count(k) != 0) || (found && out != k)) return std::fprintf(stderr, "get mismatch at %zu\n", size_t(k));
+            }
+        }
+    }
+    return check_contents(tree, ref, "single-threaded");
+}
+
+// Emptying whole runs of keys unlinks their leaves and retires them through the epoch manager.
+int check_retirement(size_t n) {
+    Tree tree;
+    std::set<uint64_t> ref;
+    for(uint64_t k = 0; k < n; ++k) tree.insert(k), ref.insert(k);
+    for(uint64_t k = 0; k < n; ++k) {
+        if(k % 1000 < 900) {
+            if(!tree.erase(k)) return std::fprintf(stderr, "retirement erase failed at %zu\n", size_t(k));
+            ref.erase(k);
+        }
+    }
+    if(int rc = check_contents(tree, ref, "after retirement")) return rc;
+    for(uint64_t k = 0; k < n; k += 3) if(tree.insert(k) != ref.insert(k).second) return std::fprintf(stderr, "reinsert mismatch\n");
+    for(const auto k: ref) if(!tree.get(k)) return std::fprintf(stderr, "missing %zu after reinsert\n", size_t(k));
+    return check_contents(tree, ref, "after reinsert");
+}
+
+// Nothing retired while another thread is inside a guard is freed until that guard is released.
+int check_epochs() {
+    auto epochs = std::make_unique<kb::EpochManager>();
+    static std::atomic<size_t> nfreed;
+    nfreed = 0;
+    auto deleter = [](void *p) {delete static_cast<int *>(p); ++nfreed;};
+    std::atomic<int> state(0);
+    std::thread reader([&] {
+        kb::EpochManager::Guard guard(*epochs);
+        state = 1;
+        while(state != 2) std::this_thread::yield();
+    });
+    while(state != 1) std::this_thread::yield();
+    for(int i = 0; i < 1000; ++i) epochs->retire(new int(i), deleter);
+    const size_t freed_while_guarded = nfreed;
+    state = 2;
+    reader.join();
+    for(int i = 0; i < 1000; ++i) epochs->retire(new int(i), deleter);
+    const size_t freed_after = nfreed;
+    epochs.reset();
+    if(freed_while_guarded) return std::fprintf(stderr, "epoch: %zu nodes freed under an active guard\n", freed_while_guarded);
+    if(freed_after == 0) return std::fprintf(stderr, "epoch: nothing reclaimed after the guard was released\n");
+    if(nfreed != 2000) return std::fprintf(stderr, "epoch: %zu of 2000 retired nodes freed\n", size_t(nfreed));
+    return 0;
+}
+
+// Nodes retired by threads which exit before reclaiming are adopted and freed by the survivors.
+int check_thread_exit() {
+    kb::EpochManager epochs;
+    static std::atomic<size_t> nfreed;
+    nfreed = 0;
+    auto deleter = [](void *p) {delete static_cast<int *>(p); ++nfreed;};
+    for(int t = 0; t < 8; ++t) {
+        // Fewer retirements than the reclaim interval, so the thread never frees its own.
+        std::thread([&] {for(int i = 0; i < 10; ++i) epochs.retire(new int(i), deleter);}).join();
+    }
+    if(nfreed) return std::fprintf(stderr, "thread exit: %zu nodes freed early\n", size_t(nfreed));
+    for(int i = 0; i < 64; ++i) epochs.retire(new int(i), deleter);
+    if(nfreed != 8 * 10 + 64) return std::fprintf(stderr, "thread exit: %zu of %d retired nodes freed\n", size_t(nfreed), 8 * 10 + 64);
+    return 0;
+}
+
+// Writers own disjoint key ranges and insert, erase and reinsert within them while
+// readers look up a stable range which must always be found.
+int check_concurrent(unsigned nwriters, unsigned nreaders, uint64_t per_writer) {
+    Tree tree;
+    const uint64_t stable_base = uint64_t(nwriters) * per_writer;
+    for(uint64_t k = 0; k < per_writer; ++k) tree.insert(stable_base + k * 2);
+    std::atomic<bool> done(false);
+    std::atomic<size_t> errors(0);
+    std::vector<std::thread> threads;
+    for(unsigned w = 0; w < nwriters; ++w) {
+        threads.emplace_back([&, w] {
+            const uint64_t base = w * per_writer;
+            for(uint64_t k = 0; k < per_writer; ++k) if(!tree.insert(base + k)) ++errors;
+            // Erase most keys so that leaves empty out and are retired.
+            for(uint64_t k = 0; k < per_writer; ++k) if(k % 10 && !tree.erase(base + k)) ++errors;
+            for(uint64_t k = 0; k < per_writer; k += 4) if(k % 10 && !tree.insert(base + k)) ++errors;
+        });
+    }
+    for(unsigned r = 0; r < nreaders; ++r) {
+        threads.emplace_back([&, r] {
+            std::mt19937_64 mt(r + 100);
+            while(!done.load(std::memory_order_relaxed)) {
+                const uint64_t k = stable_base + (mt() % per_writer) * 2;
+                uint64_t out;
+                if(!tree.get(k, &out) || out != k || tree.get(k + 1)) ++errors;
+                tree.get(mt() % stable_base);
+            }
+        });
+    }
+    for(unsigned w = 0; w < nwriters; ++w) threads[w].join();
+    done = true;
+    for(size_t i = nwriters; i < threads.size(); ++i) threads[i].join();
+    if(errors) return std::fprintf(stderr, "concurrent: %zu failed operations\n", size_t(errors));
+    std::set<uint64_t> ref;
+    for(unsigned w = 0; w < nwriters; ++w)
+        for(uint64_t k = 0; k < per_writer; ++k)
+            if(k % 10 == 0 || k % 4 == 0) ref.insert(w * per_writer + k);
+    for(uint64_t k = 0; k < per_writer; ++k) ref.insert(stable_base + k * 2);
+    return check_contents(tree, ref, "concurrent");
+}
+
+int main() {
+    int rc = 0;
+    rc |= check_single(200000);
+    rc |= check_retirement(100000);
+    rc |= check_epochs();
+    rc |= check_thread_exit();
+    rc |= check_concurrent(4, 4, 50000);
+    std::fprintf(stderr, "kbolctest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}
@@ -0,0 +1,299 @@
+#ifndef KBTREE_PACK_H__
+#define KBTREE_PACK_H__
+#include "kb.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Compressed, read-only sorted sets built from a finished kb::KBTree (or any
+ * sorted sequence). Keys are grouped into leaves of BLOCK entries; a dense
+ * array of leaf head keys is searched first, then the leaf itself.
+ *
+ * PackedIntSet stores each leaf as a full-width base plus 8/16/32/64-bit deltas,
+ * chosen per leaf from the leaf's range, and binary searches the deltas in place.
+ * FrontCodedSet stores string leaves as a full head string followed by
+ * (shared prefix length, suffix) pairs, ordered by memcmp.
+ *
+ * These are separate structures, not a leaf encoding for KBTree itself: KBTree
+ * nodes are fixed-size and keys are memcpy'd between them on split and erase.
+ * Compressed leaves for the mutable tree, behind a leaf policy like NodeAlloc,
+ * are not implemented yet.
+ */
+
+namespace kb {
+
+template<typename T, unsigned BLOCK=128>
+class PackedIntSet {
+    static_assert(std::is_integral<T>::value, "PackedIntSet requires integral keys.");
+    static_assert(BLOCK >= 2 && BLOCK <= 65535, "BLOCK must fit in 16 bits.");
+public:
+    using key_t = T;
+    using u_t   = typename std::make_unsigned<T>::type;
+private:
+    struct leaf_t {uint64_t offset; uint16_t n; uint8_t width;};
+    std::vector<u_t> heads_;
+    std::vector<leaf_t> leaves_;
+    std::vector<uint8_t> data_;
+    size_t n_;
+
+    // Order-preserving map to unsigned so that deltas are non-negative.
+    static constexpr u_t SIGN_FLIP = std::is_signed<T>::value ? u_t(1) << (sizeof(T) * 8 - 1): u_t(0);
+    static u_t to_u(T x)   {return u_t(x) ^ SIGN_FLIP;}
+    static T   from_u(u_t x) {return T(x ^ SIGN_FLIP);}
+
+    // Deltas live in byte storage, so they are read and written with memcpy.
+    template<typename W>
+    static W load(const uint8_t *p, unsigned i) {W ret; std::memcpy(&ret, p + i * sizeof(W), sizeof(W)); return ret;}
+    template<typename W>
+    static unsigned lower_bound_in(const uint8_t *p, unsigned n, u_t delta) {
+        if(delta > std::numeric_limits<W>::max()) return n;
+        unsigned lo = 0, hi = n;
+        while(lo < hi) {
+            const unsigned mid = (lo + hi) >> 1;
+            if(load<W>(p, mid) < W(delta)) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    unsigned leaf_lower_bound(size_t li, u_t x) const {
+        const leaf_t &leaf = leaves_[li];
+        const uint8_t *p = data_.data() + leaf.offset;
+        const u_t delta = x - heads_[li];
+        switch(leaf.width) {
+            case 1:  return lower_bound_in<uint8_t>(p, leaf.n, delta);
+            case 2:  return lower_bound_in<uint16_t>(p, leaf.n, delta);
+            case 4:  return lower_bound_in<uint32_t>(p, leaf.n, delta);
+            default: return lower_bound_in<uint64_t>(p, leaf.n, delta);
+        }
+    }
+    u_t leaf_get(size_t li, unsigned i) const {
+        const leaf_t &leaf = leaves_[li];
+        const uint8_t *p = data_.data() + leaf.offset;
+        switch(leaf.width) {
+            case 1:  return heads_[li] + load<uint8_t>(p, i);
+            case 2:  return heads_[li] + load<uint16_t>(p, i);
+            case 4:  return heads_[li] + load<uint32_t>(p, i);
+            default: return heads_[li] + u_t(load<uint64_t>(p, i));
+        }
+    }
+    // Index of the last leaf whose head is <= x, or -1.
+    ptrdiff_t find_leaf(u_t x) const {
+        return std::upper_bound(heads_.begin(), heads_.end(), x) - heads_.begin() - 1;
+    }
+    template<typename W>
+    void append_leaf(const u_t *keys, unsigned n) {
+        const size_t offset = (data_.size() + sizeof(W) - 1) / sizeof(W) * sizeof(W);
+        data_.resize(offset + n * sizeof(W));
+        for(unsigned i = 0; i < n; ++i) {
+            const W d = W(keys[i] - keys[0]);
+            std::memcpy(data_.data() + offset + i * sizeof(W), &d, sizeof(W));
+        }
+        leaves_.push_back(leaf_t{offset, uint16_t(n), uint8_t(sizeof(W))});
+    }
+
+public:
+    PackedIntSet(): n_(0) {}
+    // [first, last) must be strictly increasing.
+    template<typename It>
+    PackedIntSet(It first, It last): n_(0) {build(first, last);}
+    template<typename KCmp, size_t MAX_DEPTH, typename NodeAlloc>
+    explicit PackedIntSet(const KBTree<T, KCmp, MAX_DEPTH, NodeAlloc> &tree): n_(0) {
+        std::vector<T> keys;
+        keys.reserve(tree.size());
+        tree.for_each([&keys](const T &k) {keys.push_back(k);});
+        build(keys.begin(), keys.end());
+    }
+
+    template<typename It>
+    void build(It first, It last) {
+        heads_.clear(); leaves_.clear(); data_.clear(); n_ = 0;
+        std::vector<u_t> buf;
+        buf.reserve(BLOCK);
+        auto flush = [&]() {
+            if(buf.empty()) return;
+            const u_t range = buf.back() - buf.front();
+            heads_.push_back(buf.front());
+            if(range <= 0xFFu)             append_leaf<uint8_t>(buf.data(), buf.size());
+            else if(range <= 0xFFFFu)      append_leaf<uint16_t>(buf.data(), buf.size());
+            else if(range <= 0xFFFFFFFFu)  append_leaf<uint32_t>(buf.data(), buf.size());
+            else                           append_leaf<uint64_t>(buf.data(), buf.size());
+            n_ += buf.size();
+            buf.clear();
+        };
+        for(; first != last; ++first) {
+            const u_t x = to_u(*first);
+            if((!buf.empty() && x <= buf.back()) || (buf.empty() && !heads_.empty() && x <= leaf_get(heads_.size() - 1, leaves_.back().n - 1)))
+                throw std::invalid_argument("PackedIntSet input must be strictly increasing.");
+            buf.push_back(x);
+            if(buf.size() == BLOCK) flush();
+        }
+        flush();
+        data_.shrink_to_fit();
+    }
+
+    size_t size() const {return n_;}
+    bool empty()  const {return n_ == 0;}
+    // Bytes used by the encoded keys and leaf directory.
+    size_t bytes() const {
+        return heads_.size() * sizeof(u_t) + leaves_.size() * sizeof(leaf_t) + data_.size();
+    }
+    bool contains(T k) const {
+        const u_t x = to_u(k);
+        const ptrdiff_t li = find_leaf(x);
+        if(li < 0) return false;
+        const unsigned i = leaf_lower_bound(li, x);
+        return i < leaves_[li].n && leaf_get(li, i) == x;
+    }
+    // Sets *out to the smallest key >= k. Returns false if there is none.
+    bool lower_bound(T k, T *out) const {
+        const u_t x = to_u(k);
+        ptrdiff_t li = find_leaf(x);
+        if(li < 0) {
+            if(heads_.empty()) return false;
+            *out = from_u(heads_[0]);
+            return true;
+        }
+        const unsigned i = leaf_lower_bound(li, x);
+        if(i < leaves_[li].n) {*out = from_u(leaf_get(li, i)); return true;}
+        if(size_t(li + 1) == heads_.size()) return false;
+        *out = from_u(heads_[li + 1]);
+        return true;
+    }
+    template<typename Func>
+    void for_each(const Func &func) const {
+        for(size_t li = 0; li < leaves_.size(); ++li)
+            for(unsigned i = 0; i < leaves_[li].n; func(from_u(leaf_get(li, i++))));
+    }
+};
+
+template<unsigned BLOCK=16>
+class FrontCodedSet {
+    static_assert(BLOCK >= 2, "BLOCK must be at least 2.");
+    std::vector<uint64_t> leaves_; // Offset of each leaf in data_.
+    std::vector<uint8_t> data_;
+    size_t n_;
+
+    static void put_varint(std::vector<uint8_t> &out, uint64_t x) {
+        for(; x >= 0x80; x >>= 7) out.push_back(uint8_t(x) | 0x80);
+        out.push_back(uint8_t(x));
+    }
+    static uint64_t get_varint(const uint8_t *&p) {
+        uint64_t ret = 0;
+        for(unsigned shift = 0;; shift += 7) {
+            const uint8_t c = *p++;
+            ret |= uint64_t(c & 0x7F) << shift;
+            if(!(c & 0x80)) return ret;
+        }
+    }
+    static int cmp(const char *a, size_t alen, const char *b, size_t blen) {
+        const size_t n = std::min(alen, blen);
+        const int c = n ? std::memcmp(a, b, n): 0;
+        return c ? c: alen < blen ? -1: alen > blen;
+    }
+    size_t leaf_n(size_t li) const {return li + 1 == leaves_.size() ? n_ - li * BLOCK: BLOCK;}
+    // Decodes leaf li, calling func(const char *, size_t) per entry until it returns false.
+    template<typename Func>
+    void scan_leaf(size_t li, std::vector<char> &buf, const Func &func) const {
+        const uint8_t *p = data_.data() + leaves_[li];
+        size_t len = get_varint(p);
+        buf.assign(reinterpret_cast<const char *>(p), reinterpret_cast<const char *>(p) + len);
+        p += len;
+        if(!func(buf.data(), buf.size())) return;
+        for(size_t i = 1, n = leaf_n(li); i < n; ++i) {
+            const size_t shared = get_varint(p), slen = get_varint(p);
+            buf.resize(shared);
+            buf.insert(buf.end(), reinterpret_cast<const char *>(p), reinterpret_cast<const char *>(p) + slen);
+            p += slen;
+            if(!func(buf.data(), buf.size())) return;
+        }
+    }
+    // Index of the last leaf whose head is <= the query, or -1.
+    ptrdiff_t find_leaf(const char *s, size_t len) const {
+        ptrdiff_t lo = 0, hi = leaves_.size();
+        while(lo < hi) {
+            const ptrdiff_t mid = (lo + hi) >> 1;
+            const uint8_t *p = data_.data() + leaves_[mid];
+            const size_t hlen = get_varint(p);
+            if(cmp(reinterpret_cast<const char *>(p), hlen, s, len) <= 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo - 1;
+    }
+
+public:
+    FrontCodedSet(): n_(0) {}
+    // [first, last) must be strictly increasing by memcmp order; elements provide data() and size().
+    template<typename It>
+    FrontCodedSet(It first, It last): n_(0) {build(first, last);}
+
+    template<typename It>
+    void build(It first, It last) {
+        leaves_.clear(); data_.clear(); n_ = 0;
+        std::vector<char> prev;
+        for(; first != last; ++first, ++n_) {
+            const char *s = reinterpret_cast<const char *>(first->data());
+            const size_t len = first->size();
+            if(n_ && cmp(prev.data(), prev.size(), s, len) >= 0)
+                throw std::invalid_argument("FrontCodedSet input must be strictly increasing.");
+            size_t shared = 0;
+            if(n_ % BLOCK == 0) {
+                leaves_.push_back(data_.size());
+            } else {
+                for(const size_t lim = std::min(len, prev.size()); shared < lim && prev[shared] == s[shared]; ++shared);
+                put_varint(data_, shared);
+            }
+            put_varint(data_, len - shared);
+            data_.insert(data_.end(), s + shared, s + len);
+            prev.assign(s, s + len);
+        }
+        data_.shrink_to_fit();
+    }
+
+    size_t size()  const {return n_;}
+    bool empty()   const {return n_ == 0;}
+    size_t bytes() const {return leaves_.size() * sizeof(uint64_t) + data_.size();}
+
+    bool contains(const char *s, size_t len) const {
+        const ptrdiff_t li = find_leaf(s, len);
+        if(li < 0) return false;
+        // Entries are compared against s without decoding them: m is the length of the common
+        // prefix of s and the previous entry, which sorts before s.
+        const uint8_t *p = data_.data() + leaves_[li];
+        size_t shared = 0, m = 0;
+        for(size_t i = 0, n = leaf_n(li); i < n; ++i) {
+            if(i) shared = get_varint(p);
+            const size_t slen = get_varint(p);
+            const char *suffix = reinterpret_cast<const char *>(p);
+            p += slen;
+            if(shared > m) continue;     // Keeps the previous entry's byte at m, which is below s[m].
+            if(shared < m) return false; // Exceeds the previous entry at a byte where that matched s.
+            size_t k = 0;
+            for(const size_t lim = std::min(slen, len - m); k < lim && suffix[k] == s[m + k]; ++k);
+            m += k;
+            if(k < slen && m < len) {
+                if(uint8_t(suffix[k]) > uint8_t(s[m])) return false;
+                continue;
+            }
+            // One is a prefix of the other.
+            if(shared + slen >= len) return shared + slen == len;
+        }
+        return false;
+    }
+    bool contains(const char *s) const {return contains(s, std::strlen(s));}
+    template<typename T> bool contains(const T &s) const {return contains(s.data(), s.size());}
+
+    // In-order traversal; func is called as func(const char *, size_t).
+    template<typename Func>
+    void for_each(const Func &func) const {
+        std::vector<char> buf;
+        for(size_t li = 0; li < leaves_.size(); ++li)
+            scan_leaf(li, buf, [&func](const char *s, size_t len) {func(s, len); return true;});
+    }
+};
+
+} // namespace kb
+
+#endif
@@ -0,0 +1,286 @@
+#include "kb.h"
+#include "kbimg.h"
+#include "kbmap.h"
+#include "kbpack.h"
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <string>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+template<typename Tree>
+int check(size_t nelem) {
+    Tree tree;
+    std::set<uint64_t> ref;
+    std::mt19937_64 mt(1337);
+    for(size_t i = 0; i < nelem; ++i) {
+        uint64_t v = mt() % (nelem * 4);
+        if(ref.insert(v).second) tree.put(v);
+    }
+    if(size_t(tree.size()) != ref.size()) return std::fprintf(stderr, "size mismatch: %zu vs %zu\n", size_t(tree.size()), ref.size());
+    for(const auto v: ref) if(tree.get(v) == nullptr || *tree.get(v) != v) return std::fprintf(stderr, "missing %zu\n", size_t(v));
+    auto it = ref.begin();
+    bool ordered = true;
+    tree.for_each([&](const uint64_t &k) {ordered &= (it != ref.end() && *it++ == k);});
+    if(!ordered || it != ref.end()) return std::fprintf(stderr, "iteration mismatch\n");
+    return 0;
+}
+
+// In-order keys match ref, every leaf is at the same depth and no node overflows.
+template<typename Tree>
+bool valid_tree(const Tree &tree, const std::vector<uint64_t> &ref) {
+    if(size_t(tree.size()) != ref.size()) return false;
+    int leaf_depth = -1;
+    bool ok = true;
+    auto walk = [&](auto &self, typename Tree::node_t *x, int depth) -> void {
+        ok &= x->n <= tree.n;
+        if(!x->is_internal) {
+            if(leaf_depth < 0) leaf_depth = depth;
+            ok &= leaf_depth == depth;
+            return;
+        }
+        for(int i = 0; i <= x->n; ++i) self(self, tree.ptr(x)[i], depth + 1);
+    };
+    walk(walk, tree.root, 0);
+    auto it = ref.begin();
+    tree.for_each([&](const uint64_t &k) {ok &= (it != ref.end() && *it++ == k);});
+    return ok && it == ref.end() && leaf_depth + 1 == tree.height();
+}
+
+template<typename Tree>
+int check_setops(size_t nelem) {
+    std::mt19937_64 mt(91);
+    for(const size_t na: {size_t(0), size_t(1), size_t(100), nelem}) {
+        for(const size_t nb: {size_t(0), size_t(7), nelem / 3}) {
+            // Multisets: values repeat, so std::set_* counting semantics apply.
+            std::vector<uint64_t> va(na), vb(nb), expected;
+            for(auto &v: va) v = mt() % (nelem / 2 + 1);
+            for(auto &v: vb) v = mt() % (nelem / 2 + 1);
+            Tree a, b;
+            for(const auto v: va) a.put(v);
+            for(const auto v: vb) b.put(v);
+            std::sort(va.begin(), va.end()); std::sort(vb.begin(), vb.end());
+            std::set_union(va.begin(), va.end(), vb.begin(), vb.end(), std::back_inserter(expected));
+            if(!valid_tree(kb::set_union(a, b), expected)) return std::fprintf(stderr, "set_union mismatch: %zu, %zu\n", na, nb);
+            expected.clear();
+            std::set_intersection(va.begin(), va.end(), vb.begin(), vb.end(), std::back_inserter(expected));
+            if(!valid_tree(kb::set_intersection(a, b), expected)) return std::fprintf(stderr, "set_intersection mismatch: %zu, %zu\n", na, nb);
+            expected.clear();
+            std::set_difference(va.begin(), va.end(), vb.begin(), vb.end(), std::back_inserter(expected));
+            if(!valid_tree(kb::set_difference(a, b), expected)) return std::fprintf(stderr, "set_difference mismatch: %zu, %zu\n", na, nb);
+            expected.clear();
+            std::merge(va.begin(), va.end(), vb.begin(), vb.end(), std::back_inserter(expected));
+            a.absorb(b);
+            if(!valid_tree(a, expected) || b.size() != 0) return std::fprintf(stderr, "overlapping absorb mismatch: %zu, %zu\n", na, nb);
+        }
+    }
+    // Bulk-built trees accept further insertions.
+    std::vector<uint64_t> keys(nelem);
+    for(size_t i = 0; i < nelem; ++i) keys[i] = i * 2;
+    Tree built;
+    built.assign_sorted(keys.begin(), keys.end());
+    if(!valid_tree(built, keys)) return std::fprintf(stderr, "assign_sorted mismatch\n");
+    for(size_t i = 0; i < nelem; i += 3) built.put(i * 2 + 1), keys.push_back(i * 2 + 1);
+    std::sort(keys.begin(), keys.end());
+    if(!valid_tree(built, keys)) return std::fprintf(stderr, "put after assign_sorted mismatch\n");
+    // Unsorted input throws and leaves the tree as it was, still usable.
+    const std::vector<uint64_t> unsorted{1, 2, 3, 2};
+    bool threw = false;
+    try {built.assign_sorted(unsorted.begin(), unsorted.end());} catch(const std::invalid_argument &) {threw = true;}
+    if(!threw || !valid_tree(built, keys)) return std::fprintf(stderr, "assign_sorted with unsorted input mismatch\n");
+    built.put(uint64_t(1) << 40); keys.push_back(uint64_t(1) << 40);
+    if(!valid_tree(built, keys)) return std::fprintf(stderr, "put after failed assign_sorted mismatch\n");
+    Tree fresh;
+    threw = false;
+    try {fresh.assign_sorted(unsorted.begin(), unsorted.end());} catch(const std::invalid_argument &) {threw = true;}
+    fresh.put(5);
+    if(!threw || !valid_tree(fresh, {5})) return std::fprintf(stderr, "empty tree after failed assign_sorted mismatch\n");
+    // Move assignment frees the target's contents and leaves the source empty and usable.
+    fresh = std::move(built);
+    if(!valid_tree(fresh, keys) || built.size() != 0) return std::fprintf(stderr, "move assignment mismatch\n");
+    built.put(5);
+    if(!valid_tree(built, {5})) return std::fprintf(stderr, "put after move assignment mismatch\n");
+    // Disjoint shards of very different sizes, absorbed in shuffled order, join without merging.
+    std::vector<size_t> bounds{0};
+    while(bounds.back() < nelem) bounds.push_back(bounds.back() + 1 + mt() % (mt() % 4 ? 50: nelem / 4));
+    std::vector<size_t> order(bounds.size() - 1);
+    for(size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), mt);
+    Tree acc;
+    std::vector<uint64_t> ref;
+    for(const auto i: order) {
+        Tree shard;
+        for(size_t v = bounds[i]; v < bounds[i + 1]; ++v) shard.put(v);
+        acc.absorb(shard);
+        if(shard.size() != 0) return std::fprintf(stderr, "absorbed shard not empty\n");
+        shard.put(1);
+    }
+    for(size_t v = 0; v < bounds.back(); ++v) ref.push_back(v);
+    if(!valid_tree(acc, ref)) return std::fprintf(stderr, "disjoint absorb mismatch\n");
+    for(size_t v = 0; v < bounds.back(); v += 5) acc.put(v), ref.push_back(v);
+    std::sort(ref.begin(), ref.end());
+    if(!valid_tree(acc, ref)) return std::fprintf(stderr, "put after absorb mismatch\n");
+    return 0;
+}
+
+int check_image(size_t nelem) {
+    kb::KBTree<uint64_t> tree;
+    std::set<uint64_t> ref;
+    std::mt19937_64 mt(13);
+    for(size_t i = 0; i < nelem; ++i) {
+        uint64_t v = (mt() % (nelem * 4)) * 2;
+        if(ref.insert(v).second) tree.put(v);
+    }
+    char path[] = "/tmp/kbtest.XXXXXX";
+    const int fd = ::mkstemp(path);
+    if(fd < 0) return std::fprintf(stderr, "could not create temporary file\n");
+    ::close(fd);
+    kb::write_image(tree, path);
+    kb::KBView<uint64_t> view(path);
+    std::remove(path);
+    if(view.size() != ref.size()) return std::fprintf(stderr, "image size mismatch\n");
+    for(const auto v: ref) {
+        if(view.get(v) == nullptr || *view.get(v) != v) return std::fprintf(stderr, "image missing %zu\n", size_t(v));
+        if(view.get(v + 1)) return std::fprintf(stderr, "image contains absent %zu\n", size_t(v + 1));
+        const uint64_t *lo, *hi;
+        view.interval(v + 1, &lo, &hi);
+        auto it = ref.upper_bound(v);
+        if(!lo || *lo != v || (it == ref.end() ? hi != nullptr: (!hi || *hi != *it))) return std::fprintf(stderr, "image interval mismatch at %zu\n", size_t(v));
+    }
+    auto it = ref.begin();
+    bool ordered = true;
+    view.for_each([&](const uint64_t &k) {ordered &= (it != ref.end() && *it++ == k);});
+    if(!ordered || it != ref.end()) return std::fprintf(stderr, "image iteration mismatch\n");
+
+    // Corrupt copies of the image must throw rather than read outside it.
+    std::FILE *fp = std::tmpfile();
+    if(fp == nullptr) return std::fprintf(stderr, "could not create temporary file\n");
+    const size_t nbytes = kb::write_image(tree, fp);
+    struct alignas(kb::IMAGE_ALIGN) chunk_t {char b[kb::IMAGE_ALIGN];};
+    std::vector<chunk_t> image((nbytes + kb::IMAGE_ALIGN - 1) / kb::IMAGE_ALIGN);
+    std::rewind(fp);
+    const bool read_ok = std::fread(image.data(), 1, nbytes, fp) == nbytes;
+    std::fclose(fp);
+    if(!read_ok) return std::fprintf(stderr, "could not read image back\n");
+    auto rejected = [&](auto &&corrupt) {
+        std::vector<chunk_t> copy(image);
+        char *base = reinterpret_cast<char *>(copy.data());
+        corrupt(reinterpret_cast<kb::image_header_t *>(base), base);
+        try {
+            kb::KBView<uint64_t> bad(copy.data(), nbytes);
+            size_t n = 0;
+            bad.for_each([&n](const uint64_t &) {++n;});
+            for(const auto v: ref) bad.get(v);
+        } catch(const std::runtime_error &) {
+            return true;
+        }
+        return false;
+    };
+    auto root_children = [](kb::image_header_t *hdr, char *base) {
+        const uint32_t n = reinterpret_cast<const uint32_t *>(base + hdr->root_off)[1];
+        return reinterpret_cast<uint64_t *>(base + hdr->root_off + kb::detail::image_child_offset<uint64_t>(n));
+    };
+    if(!rejected([](kb::image_header_t *hdr, char *) {hdr->root_off = hdr->image_size + kb::IMAGE_ALIGN;}))
+        return std::fprintf(stderr, "image with out-of-bounds root accepted\n");
+    if(!rejected([](kb::image_header_t *hdr, char *) {hdr->image_size = hdr->root_off + 2 * kb::IMAGE_ALIGN;}))
+        return std::fprintf(stderr, "image with short image_size accepted\n");
+    if(!rejected([&](kb::image_header_t *hdr, char *base) {root_children(hdr, base)[1] = uint64_t(1) << 40;}))
+        return std::fprintf(stderr, "image with out-of-bounds child accepted\n");
+    if(!rejected([&](kb::image_header_t *hdr, char *base) {root_children(hdr, base)[0] = hdr->root_off;}))
+        return std::fprintf(stderr, "image with a cycle accepted\n");
+    {
+        std::vector<chunk_t> shifted(image.size() + 1);
+        char *base = reinterpret_cast<char *>(shifted.data()) + 8;
+        std::memcpy(base, image.data(), nbytes);
+        bool threw = false;
+        try {kb::KBView<uint64_t> bad(base, nbytes);} catch(const std::runtime_error &) {threw = true;}
+        if(!threw) return std::fprintf(stderr, "misaligned image buffer accepted\n");
+    }
+    return 0;
+}
+
+template<typename Map>
+int check_map(size_t nelem) {
+    Map map;
+    std::map<uint64_t, std::string> ref;
+    std::mt19937_64 mt(31);
+    for(size_t i = 0; i < nelem; ++i) {
+        const uint64_t k = mt() % nelem;
+        const std::string v(k % 64 + 1, char('a' + k % 26));
+        switch(mt() % 4) {
+            case 0: if(map.erase(k) != ref.erase(k)) return std::fprintf(stderr, "map erase mismatch\n"); break;
+            case 1: map.insert_or_assign(k, v + "!"); ref[k] = v + "!"; break;
+            default: if(map.try_emplace(k, v).second != ref.emplace(k, v).second) return std::fprintf(stderr, "map try_emplace mismatch\n");
+        }
+    }
+    if(map.size() != ref.size()) return std::fprintf(stderr, "map size mismatch\n");
+    for(const auto &pair: ref) {
+        const std::string *v = map.find(pair.first);
+        if(v == nullptr || *v != pair.second) return std::fprintf(stderr, "map missing %zu\n", size_t(pair.first));
+    }
+    auto it = ref.begin();
+    bool ordered = true;
+    map.for_each([&](const uint64_t &k, std::string &v) {ordered &= (it != ref.end() && it->first == k && it->second == v); ++it;});
+    if(!ordered || it != ref.end()) return std::fprintf(stderr, "map iteration mismatch\n");
+    return 0;
+}
+
+int check_pack(size_t nelem) {
+    kb::KBTree<uint64_t> tree;
+    std::set<uint64_t> ref;
+    std::mt19937_64 mt(57);
+    for(uint64_t pos = 1000000; ref.size() < nelem;) {
+        pos += 1 + mt() % (ref.size() % 1000 == 0 ? 1000000: 300);
+        ref.insert(pos);
+        tree.put(pos);
+    }
+    kb::PackedIntSet<uint64_t> packed(tree);
+    if(packed.size() != ref.size()) return std::fprintf(stderr, "packed size mismatch\n");
+    if(packed.bytes() * 2 > ref.size() * sizeof(uint64_t)) return std::fprintf(stderr, "packed set is not compressed: %zu bytes\n", packed.bytes());
+    for(const auto v: ref) {
+        uint64_t lb;
+        if(!packed.contains(v) || packed.contains(v + 1) != (ref.count(v + 1) != 0)) return std::fprintf(stderr, "packed contains mismatch\n");
+        auto it = ref.upper_bound(v);
+        if(packed.lower_bound(v + 1, &lb) != (it != ref.end()) || (it != ref.end() && lb != *it)) return std::fprintf(stderr, "packed lower_bound mismatch\n");
+    }
+    std::vector<int32_t> signed_keys{-1000000, -5, -2, 1, 3, 70000, 2000000000};
+    kb::PackedIntSet<int32_t, 4> sset(signed_keys.begin(), signed_keys.end());
+    for(const auto v: signed_keys) if(!sset.contains(v) || sset.contains(v + 1)) return std::fprintf(stderr, "signed packed mismatch\n");
+
+    std::set<std::string> sref;
+    for(size_t i = 0; i < nelem / 10; ++i) sref.insert("chr" + std::to_string(mt() % 30) + ":" + std::to_string(mt() % 100000));
+    kb::FrontCodedSet<> fc(sref.begin(), sref.end());
+    for(const auto &s: sref) if(!fc.contains(s) || fc.contains(s + "x")) return std::fprintf(stderr, "front-coded contains mismatch\n");
+    if(fc.contains("") || fc.contains("zzz")) return std::fprintf(stderr, "front-coded contains absent\n");
+    // Near misses: truncations and last-byte changes land between and inside leaves.
+    for(const auto &s: sref) {
+        std::string q = s.substr(0, s.size() - 1);
+        if(fc.contains(q) != (sref.count(q) != 0)) return std::fprintf(stderr, "front-coded prefix mismatch\n");
+        for(const int d: {-1, 1}) {
+            q = s; q.back() = char(q.back() + d);
+            if(fc.contains(q) != (sref.count(q) != 0)) return std::fprintf(stderr, "front-coded near miss mismatch\n");
+        }
+    }
+    auto it = sref.begin();
+    bool ordered = true;
+    fc.for_each([&](const char *s, size_t len) {ordered &= (it != sref.end() && *it++ == std::string(s, len));});
+    if(!ordered || it != sref.end()) return std::fprintf(stderr, "front-coded iteration mismatch\n");
+    return 0;
+}
+
+int main() {
+    int rc = 0;
+    rc |= check<kb::KBTree<uint64_t>>(100000);
+    rc |= check<kb::KBTree<uint64_t, kb::DefaultCmp, 64, kb::MallocNodeAlloc>>(100000);
+    rc |= check_setops<kb::KBTree<uint64_t>>(50000);
+    rc |= check_setops<kb::KBTree<uint64_t, kb::DefaultCmp, 64, kb::MallocNodeAlloc>>(50000);
+    rc |= check_image(100000);
+    rc |= check_map<kb::KBMap<uint64_t, std::string>>(200000);
+    rc |= check_map<kb::KBMap<uint64_t, std::string, kb::DefaultCmp, 256, kb::MallocNodeAlloc>>(200000);
+    rc |= check_pack(200000);
+    std::fprintf(stderr, "kbtest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}
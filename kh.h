@@ -0,0 +1,385 @@
+#ifndef KH_H__
+#define KH_H__
+#include "khash_fn.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Fast non-cryptographic hashing and an open-addressing hash map.
+ *
+ * kh::hash is wyhash (final version 4, Wang Yi, released into the public domain),
+ * defined in khash_fn.h.
+ * kh::Hash and kh::Equal treat anything with data() and size() as a byte string,
+ * so a kh::FlatMap keyed by ks::string or std::string can be queried with a
+ * std::string_view, a (pointer, length) pair or another string type without
+ * constructing a key.
+ *
+ * kh::Interner stores each distinct string once in an arena and hands out dense
+ * 32-bit ids; kh::ConcurrentInterner shards it by hash for multithreaded use.
+ */
+
+namespace kh {
+using std::size_t;
+using std::uint64_t;
+
+namespace detail {
+template<typename T, typename=void>
+struct is_bytes: std::false_type {};
+template<typename T>
+struct is_bytes<T, std::void_t<decltype(std::declval<const T &>().data()), decltype(std::declval<const T &>().size())>>:
+    std::integral_constant<bool, sizeof(*std::declval<const T &>().data()) == 1> {};
+} // namespace detail
+
+struct Hash {
+    uint64_t operator()(const char *s) const {return hash(s, std::strlen(s));}
+    uint64_t operator()(std::string_view s) const {return hash(s.data(), s.size());}
+    template<typename T, typename=std::enable_if_t<detail::is_bytes<T>::value>>
+    uint64_t operator()(const T &s) const {return hash(s.data(), s.size());}
+    template<typename T, typename=std::enable_if_t<std::is_integral<T>::value>, typename=void>
+    uint64_t operator()(T x) const {return hash(uint64_t(x));}
+};
+
+struct Equal {
+    template<typename A, typename B>
+    bool operator()(const A &a, const B &b) const {
+        if constexpr(detail::is_bytes<A>::value && detail::is_bytes<B>::value) {
+            return a.size() == b.size() && (a.size() == 0 || std::memcmp(a.data(), b.data(), a.size()) == 0);
+        } else {
+            return a == b;
+        }
+    }
+};
+
+template<typename KeyType, typename ValueType, typename HashFn=Hash, typename EqFn=Equal>
+class FlatMap {
+    // Linear probing over a control byte array: 0 is empty, 1 is a tombstone, and
+    // full slots hold 0x80 | 7 bits of the hash, so most mismatches never touch the slot.
+    static constexpr uint8_t EMPTY = 0, DELETED = 1;
+    struct slot_t {KeyType key; ValueType value;};
+public:
+    using key_t    = KeyType;
+    using mapped_t = ValueType;
+private:
+    uint8_t *ctrl_;
+    slot_t *slots_;
+    size_t cap_, size_, used_; // used_ counts full slots and tombstones.
+    HashFn hash_;
+    EqFn eq_;
+
+    static uint8_t tag(uint64_t h) {return uint8_t(0x80 | (h >> 57));}
+    size_t max_used() const {return cap_ - (cap_ >> 3);}
+    template<typename Q>
+    size_t find_index(const Q &q, uint64_t h) const {
+        if(cap_ == 0) return size_t(-1);
+        const uint8_t t = tag(h);
+        for(size_t i = h & (cap_ - 1);; i = (i + 1) & (cap_ - 1)) {
+            if(ctrl_[i] == t && eq_(slots_[i].key, q)) return i;
+            if(ctrl_[i] == EMPTY) return size_t(-1);
+        }
+    }
+    // Slot for a new entry with hash h, which must not be present.
+    size_t insert_index(uint64_t h) const {
+        for(size_t i = h & (cap_ - 1);; i = (i + 1) & (cap_ - 1))
+            if(ctrl_[i] < 0x80) return i;
+    }
+    void rehash(size_t newcap) {
+        uint8_t *octrl = ctrl_;
+        slot_t *oslots = slots_;
+        const size_t ocap = cap_;
+        ctrl_ = static_cast<uint8_t *>(std::calloc(newcap, 1));
+        slots_ = static_cast<slot_t *>(std::malloc(newcap * sizeof(slot_t)));
+        if(ctrl_ == nullptr || slots_ == nullptr) {
+            std::free(ctrl_); std::free(slots_);
+            ctrl_ = octrl; slots_ = oslots;
+            throw std::bad_alloc();
+        }
+        cap_ = newcap;
+        used_ = size_;
+        for(size_t i = 0; i < ocap; ++i) {
+            if(octrl[i] < 0x80) continue;
+            const uint64_t h = hash_(oslots[i].key);
+            const size_t j = insert_index(h);
+            ctrl_[j] = tag(h);
+            new(slots_ + j) slot_t{std::move(oslots[i].key), std::move(oslots[i].value)};
+            oslots[i].~slot_t();
+        }
+        std::free(octrl);
+        std::free(oslots);
+    }
+    void grow_if_needed() {
+        if(cap_ == 0) rehash(16);
+        else if(used_ + 1 > max_used()) rehash(size_ + 1 > (cap_ >> 1) ? cap_ << 1: cap_);
+    }
+    template<typename Q>
+    static key_t make_key(const Q &q) {
+        if constexpr(std::is_constructible<key_t, const Q &>::value) return key_t(q);
+        else return key_t(q.data(), q.size());
+    }
+    template<typename Q, typename... Args>
+    std::pair<mapped_t *, bool> emplace_impl(const Q &q, uint64_t h, Args &&... args) {
+        size_t i = find_index(q, h);
+        if(i != size_t(-1)) return {&slots_[i].value, false};
+        grow_if_needed();
+        i = insert_index(h);
+        new(slots_ + i) slot_t{make_key(q), mapped_t(std::forward<Args>(args)...)};
+        used_ += ctrl_[i] == EMPTY;
+        ctrl_[i] = tag(h);
+        ++size_;
+        return {&slots_[i].value, true};
+    }
+
+public:
+    FlatMap(): ctrl_(nullptr), slots_(nullptr), cap_(0), size_(0), used_(0) {}
+    FlatMap(size_t n): FlatMap() {reserve(n);}
+    FlatMap(const FlatMap &) = delete;
+    FlatMap &operator=(const FlatMap &) = delete;
+    FlatMap(FlatMap &&o): ctrl_(o.ctrl_), slots_(o.slots_), cap_(o.cap_), size_(o.size_), used_(o.used_) {
+        o.ctrl_ = nullptr; o.slots_ = nullptr; o.cap_ = o.size_ = o.used_ = 0;
+    }
+    ~FlatMap() {
+        clear();
+        std::free(ctrl_);
+        std::free(slots_);
+    }
+
+    size_t size()     const {return size_;}
+    bool empty()      const {return size_ == 0;}
+    size_t capacity() const {return cap_;}
+    void reserve(size_t n) {
+        size_t newcap = 16;
+        while(newcap - (newcap >> 3) < n) newcap <<= 1;
+        if(newcap > cap_) rehash(newcap);
+    }
+    void clear() {
+        for(size_t i = 0; i < cap_; ++i) {
+            if(ctrl_[i] >= 0x80) slots_[i].~slot_t();
+            ctrl_[i] = EMPTY;
+        }
+        size_ = used_ = 0;
+    }
+
+    // Lookups accept the key type or anything HashFn and EqFn accept alongside it.
+    template<typename Q>
+    mapped_t *find(const Q &q) {return find_hashed(q, hash_(q));}
+    template<typename Q>
+    const mapped_t *find(const Q &q) const {return const_cast<FlatMap *>(this)->find(q);}
+    mapped_t *find(const char *s, size_t len) {return find(std::string_view(s, len));}
+    const mapped_t *find(const char *s, size_t len) const {return find(std::string_view(s, len));}
+    template<typename Q>
+    bool contains(const Q &q) const {return find(q) != nullptr;}
+
+    // The key is only constructed (from q) if it is absent.
+    template<typename Q, typename... Args>
+    std::pair<mapped_t *, bool> try_emplace(const Q &q, Args &&... args) {return emplace_impl(q, hash_(q), std::forward<Args>(args)...);}
+    template<typename Q, typename M>
+    std::pair<mapped_t *, bool> insert_or_assign(const Q &q, M &&obj) {
+        auto ret = emplace_impl(q, hash_(q), std::forward<M>(obj));
+        if(!ret.second) *ret.first = std::forward<M>(obj);
+        return ret;
+    }
+    template<typename Q>
+    mapped_t &operator[](const Q &q) {return *emplace_impl(q, hash_(q)).first;}
+
+    // As find() and try_emplace(), with h = HashFn()(q) computed by the caller, for callers which
+    // already need the hash or look up the same key more than once.
+    template<typename Q>
+    mapped_t *find_hashed(const Q &q, uint64_t h) {
+        const size_t i = find_index(q, h);
+        return i == size_t(-1) ? nullptr: &slots_[i].value;
+    }
+    template<typename Q>
+    const mapped_t *find_hashed(const Q &q, uint64_t h) const {return const_cast<FlatMap *>(this)->find_hashed(q, h);}
+    template<typename Q, typename... Args>
+    std::pair<mapped_t *, bool> try_emplace_hashed(const Q &q, uint64_t h, Args &&... args) {return emplace_impl(q, h, std::forward<Args>(args)...);}
+    // Like std::unordered_map::at, throws std::out_of_range if the key is absent.
+    template<typename Q>
+    mapped_t &at(const Q &q) {
+        if(mapped_t *ret = find(q)) return *ret;
+        throw std::out_of_range("kh::FlatMap::at: key not found.");
+    }
+    template<typename Q>
+    const mapped_t &at(const Q &q) const {return const_cast<FlatMap *>(this)->at(q);}
+    mapped_t &at(const char *s, size_t len) {return at(std::string_view(s, len));}
+    const mapped_t &at(const char *s, size_t len) const {return at(std::string_view(s, len));}
+
+    template<typename Q>
+    size_t erase(const Q &q) {
+        const size_t i = find_index(q, hash_(q));
+        if(i == size_t(-1)) return 0;
+        slots_[i].~slot_t();
+        // A slot followed by an empty one ends every probe sequence through it, so it can be emptied.
+        if(ctrl_[(i + 1) & (cap_ - 1)] == EMPTY) ctrl_[i] = EMPTY, --used_;
+        else ctrl_[i] = DELETED;
+        --size_;
+        return 1;
+    }
+
+    // func is called as func(const key_t &, mapped_t &).
+    template<typename Func>
+    void for_each(const Func &func) {
+        for(size_t i = 0; i < cap_; ++i) if(ctrl_[i] >= 0x80) func(const_cast<const key_t &>(slots_[i].key), slots_[i].value);
+    }
+    template<typename Func>
+    void for_each(const Func &func) const {
+        for(size_t i = 0; i < cap_; ++i) if(ctrl_[i] >= 0x80) func(slots_[i].key, static_cast<const mapped_t &>(slots_[i].value));
+    }
+};
+
+// Stores each distinct string once and maps it to a dense 32-bit id, assigned in
+// first-seen order. Strings are NUL-terminated in large arena chunks and the id
+// directory grows in segments which are never moved, so ids, views and c_str()
+// pointers stay valid for the interner's lifetime.
+class Interner {
+public:
+    using id_t = uint32_t;
+    static constexpr id_t NONE = id_t(-1);
+private:
+    static constexpr size_t CHUNK = size_t(1) << 16, SEG0 = 1024, NSEGS = 23; // SEG0 << NSEGS exceeds 2^32 ids.
+    std::string_view *segs_[NSEGS];
+    std::vector<char *> chunks_;
+    char *cur_, *end_;
+    size_t n_, bytes_;
+    FlatMap<std::string_view, id_t> map_;
+
+    // Segment s holds ids [SEG0 * (2^s - 1), SEG0 * (2^(s+1) - 1)).
+    static unsigned seg_of(size_t i) {return 63 - __builtin_clzll(i / SEG0 + 1);}
+    std::string_view &slot(size_t i) const {
+        const unsigned s = seg_of(i);
+        return segs_[s][i - SEG0 * ((size_t(1) << s) - 1)];
+    }
+    const char *store(const char *s, size_t len) {
+        if(size_t(end_ - cur_) < len + 1) {
+            const size_t sz = std::max(CHUNK, len + 1);
+            char *chunk = static_cast<char *>(std::malloc(sz));
+            if(chunk == nullptr) throw std::bad_alloc();
+            chunks_.push_back(chunk);
+            cur_ = chunk; end_ = chunk + sz;
+        }
+        char *ret = cur_;
+        if(len) std::memcpy(ret, s, len);
+        ret[len] = '\0';
+        cur_ += len + 1;
+        bytes_ += len + 1;
+        return ret;
+    }
+
+public:
+    Interner(): segs_{}, cur_(nullptr), end_(nullptr), n_(0), bytes_(0) {}
+    Interner(const Interner &) = delete;
+    Interner &operator=(const Interner &) = delete;
+    ~Interner() {
+        for(auto p: segs_) std::free(p);
+        for(auto p: chunks_) std::free(p);
+    }
+
+    id_t intern(const char *s, size_t len) {return intern_hashed(s, len, hash(s, len));}
+    // h must be kh::hash(s, len).
+    id_t intern_hashed(const char *s, size_t len, uint64_t h) {
+        const std::string_view q(s, len);
+        if(const id_t *id = map_.find_hashed(q, h)) return *id;
+        if(n_ == NONE) throw std::runtime_error("Interner is full.");
+        const unsigned seg = seg_of(n_);
+        if(segs_[seg] == nullptr && (segs_[seg] = static_cast<std::string_view *>(std::malloc((SEG0 << seg) * sizeof(std::string_view)))) == nullptr)
+            throw std::bad_alloc();
+        const std::string_view stored(store(s, len), len);
+        map_.try_emplace_hashed(stored, h, id_t(n_));
+        slot(n_) = stored;
+        return id_t(n_++);
+    }
+    id_t intern(const char *s) {return intern(s, std::strlen(s));}
+    template<typename T, typename=std::enable_if_t<detail::is_bytes<T>::value>>
+    id_t intern(const T &s) {return intern(reinterpret_cast<const char *>(s.data()), s.size());}
+
+    // Returns the id of s, or NONE if it has not been interned.
+    id_t find(const char *s, size_t len) const {return find_hashed(s, len, hash(s, len));}
+    id_t find_hashed(const char *s, size_t len, uint64_t h) const {
+        const id_t *id = map_.find_hashed(std::string_view(s, len), h);
+        return id ? *id: NONE;
+    }
+    id_t find(const char *s) const {return find(s, std::strlen(s));}
+    template<typename T, typename=std::enable_if_t<detail::is_bytes<T>::value>>
+    id_t find(const T &s) const {return find(reinterpret_cast<const char *>(s.data()), s.size());}
+
+    // id must have been returned by intern().
+    std::string_view view(id_t id) const {return slot(id);}
+    const char *c_str(id_t id)    const {return slot(id).data();}
+
+    size_t size()  const {return n_;}
+    // Bytes of string data stored, including terminators.
+    size_t bytes() const {return bytes_;}
+};
+
+// Interner split into SHARDS independently locked shards chosen by hash.
+// Ids interleave shards (id % SHARDS is the shard), so they are dense overall but
+// not in first-seen order. view() and c_str() take no lock.
+template<unsigned SHARDS=16>
+class ConcurrentInterner {
+    static_assert(SHARDS && (SHARDS & (SHARDS - 1)) == 0, "SHARDS must be a power of two.");
+public:
+    using id_t = Interner::id_t;
+    static constexpr id_t NONE = Interner::NONE;
+private:
+    struct alignas(64) shard_t {
+        mutable std::mutex m;
+        Interner in;
+    };
+    shard_t shards_[SHARDS];
+    // The shard comes from bits of the hash which the shard's own table does not index by.
+    static unsigned shard_of(uint64_t h) {return unsigned(h >> 40) & (SHARDS - 1);}
+
+public:
+    id_t intern(const char *s, size_t len) {
+        const uint64_t h = hash(s, len);
+        const unsigned si = shard_of(h);
+        Interner::id_t local;
+        {
+            std::lock_guard<std::mutex> lock(shards_[si].m);
+            local = shards_[si].in.intern_hashed(s, len, h);
+        }
+        if(local >= NONE / SHARDS) throw std::runtime_error("ConcurrentInterner shard is full.");
+        return local * SHARDS + si;
+    }
+    id_t intern(const char *s) {return intern(s, std::strlen(s));}
+    template<typename T, typename=std::enable_if_t<detail::is_bytes<T>::value>>
+    id_t intern(const T &s) {return intern(reinterpret_cast<const char *>(s.data()), s.size());}
+
+    id_t find(const char *s, size_t len) const {
+        const uint64_t h = hash(s, len);
+        const unsigned si = shard_of(h);
+        std::lock_guard<std::mutex> lock(shards_[si].m);
+        const id_t local = shards_[si].in.find_hashed(s, len, h);
+        return local == NONE ? NONE: local * SHARDS + si;
+    }
+    id_t find(const char *s) const {return find(s, std::strlen(s));}
+    template<typename T, typename=std::enable_if_t<detail::is_bytes<T>::value>>
+    id_t find(const T &s) const {return find(reinterpret_cast<const char *>(s.data()), s.size());}
+
+    std::string_view view(id_t id) const {return shards_[id & (SHARDS - 1)].in.view(id / SHARDS);}
+    const char *c_str(id_t id)    const {return shards_[id & (SHARDS - 1)].in.c_str(id / SHARDS);}
+
+    size_t size() const {
+        size_t ret = 0;
+        for(const auto &shard: shards_) {
+            std::lock_guard<std::mutex> lock(shard.m);
+            ret += shard.in.size();
+        }
+        return ret;
+    }
+};
+
+} // namespace kh
+
+#undef KH_LIKELY
+#undef KH_UNLIKELY
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef KHASH_FN_H__
+#define KHASH_FN_H__
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * kh::hash is wyhash (final version 4, Wang Yi, released into the public domain).
+ * It is kept apart from kh.h so that ks.h can hash ks::string without pulling in
+ * the hash map.
+ */
+
+namespace kh {
+using std::size_t;
+using std::uint64_t;
+
+namespace detail {
+#ifdef __GNUC__
+#  define KH_LIKELY(x) __builtin_expect((x),1)
+#  define KH_UNLIKELY(x) __builtin_expect((x),0)
+#else
+#  define KH_LIKELY(x) (x)
+#  define KH_UNLIKELY(x) (x)
+#endif
+static inline void wymum(uint64_t *a, uint64_t *b) {
+    const __uint128_t r = __uint128_t(*a) * *b;
+    *a = uint64_t(r); *b = uint64_t(r >> 64);
+}
+static inline uint64_t wymix(uint64_t a, uint64_t b) {wymum(&a, &b); return a ^ b;}
+static inline uint64_t wyr8(const uint8_t *p) {uint64_t v; std::memcpy(&v, p, 8); return v;}
+static inline uint64_t wyr4(const uint8_t *p) {uint32_t v; std::memcpy(&v, p, 4); return v;}
+static inline uint64_t wyr3(const uint8_t *p, size_t k) {return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];}
+static constexpr uint64_t WYP[4] {0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL};
+
+} // namespace detail
+
+inline uint64_t hash(const void *key, size_t len, uint64_t seed=0) {
+    using namespace detail;
+    const uint8_t *p = static_cast<const uint8_t *>(key);
+    uint64_t a, b;
+    seed ^= wymix(seed ^ WYP[0], WYP[1]);
+    if(KH_LIKELY(len <= 16)) {
+        if(KH_LIKELY(len >= 4)) {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        } else if(KH_LIKELY(len > 0)) {
+            a = wyr3(p, len); b = 0;
+        } else a = b = 0;
+    } else {
+        size_t i = len;
+        if(KH_UNLIKELY(i > 48)) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ WYP[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ WYP[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ WYP[3], wyr8(p + 40) ^ see2);
+                p += 48; i -= 48;
+            } while(KH_LIKELY(i > 48));
+            seed ^= see1 ^ see2;
+        }
+        while(KH_UNLIKELY(i > 16)) {
+            seed = wymix(wyr8(p) ^ WYP[1], wyr8(p + 8) ^ seed);
+            i -= 16; p += 16;
+        }
+        a = wyr8(p + i - 16); b = wyr8(p + i - 8);
+    }
+    a ^= WYP[1]; b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ WYP[0] ^ len, b ^ WYP[1]);
+}
+inline uint64_t hash(uint64_t x, uint64_t seed=0) {
+    return detail::wymix(x ^ seed ^ detail::WYP[0], detail::WYP[1]);
+}
+
+} // namespace kh
+
+#endif
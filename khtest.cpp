@@ -0,0 +1,90 @@
+#include "ks.h"
+#include "kh.h"
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+int main() {
+    int rc = 0;
+    std::mt19937_64 mt(13);
+    // Hash every length across the short/medium/long code paths, and check it depends only on the bytes.
+    std::unordered_set<uint64_t> hashes;
+    std::string buf;
+    for(size_t len = 0; len < 200; ++len) {
+        buf.assign(len, 'x');
+        const uint64_t h = kh::hash(buf.data(), len);
+        hashes.insert(h);
+        if(std::hash<ks::string>()(ks::string(buf)) != h) rc |= std::fprintf(stderr, "std::hash mismatch at %zu\n", len);
+    }
+    if(hashes.size() != 200) rc |= std::fprintf(stderr, "length collisions\n");
+
+    kh::FlatMap<ks::string, uint64_t> map;
+    std::unordered_map<std::string, uint64_t> ref;
+    for(size_t i = 0; i < 100000; ++i) {
+        const std::string key = std::to_string(mt() % 20000);
+        ++map[std::string_view(key)];
+        ++ref[key];
+        if(i % 7 == 0) {
+            const std::string victim = std::to_string(mt() % 20000);
+            if(map.erase(ks::string(victim)) != ref.erase(victim)) rc |= std::fprintf(stderr, "erase mismatch\n");
+        }
+    }
+    if(map.size() != ref.size()) rc |= std::fprintf(stderr, "size mismatch %zu vs %zu\n", map.size(), ref.size());
+    for(const auto &pair: ref) {
+        const uint64_t *v = map.find(pair.first.data(), pair.first.size());
+        if(v == nullptr || *v != pair.second) {rc |= std::fprintf(stderr, "missing %s\n", pair.first.data()); break;}
+    }
+    size_t n = 0;
+    map.for_each([&](const ks::string &k, uint64_t v) {n += ref.at(k.data()) == v;});
+    if(n != ref.size()) rc |= std::fprintf(stderr, "for_each mismatch\n");
+    if(map.contains("absent") || !map.try_emplace(std::string("absent"), 5).second || *map.find("absent") != 5)
+        rc |= std::fprintf(stderr, "try_emplace failed\n");
+    {
+        const size_t before = map.size();
+        bool threw = false;
+        try {map.at("not a key", 9);} catch(const std::out_of_range &) {threw = true;}
+        if(!threw || map.size() != before || map.at(std::string_view("absent")) != 5)
+            rc |= std::fprintf(stderr, "at did not throw for a missing key\n");
+    }
+    {
+        // The hashed variants must agree with the plain ones when given HashFn's value.
+        const std::string_view key("hashed");
+        const uint64_t h = kh::Hash()(key);
+        if(map.find_hashed(key, h) || !map.try_emplace_hashed(key, h, 9).second || map.try_emplace_hashed(key, h, 10).second
+           || *map.find(key) != 9 || *map.find_hashed(ks::string(key.data(), key.size()), h) != 9)
+            rc |= std::fprintf(stderr, "hashed lookup mismatch\n");
+    }
+
+    kh::FlatMap<uint64_t, std::string> imap;
+    for(uint64_t i = 0; i < 1000; ++i) imap.insert_or_assign(i * 4096, std::to_string(i));
+    for(uint64_t i = 0; i < 1000; ++i) if(*imap.find(i * 4096) != std::to_string(i)) {rc |= std::fprintf(stderr, "int map failed\n"); break;}
+
+    kh::Interner interner;
+    std::vector<kh::Interner::id_t> ids;
+    std::vector<std::string> words;
+    for(size_t i = 0; i < 5000; ++i) words.push_back(std::string(mt() % 3, 'x') + std::to_string(mt() % 3000));
+    for(const auto &w: words) ids.push_back(interner.intern(w));
+    const std::string_view first = interner.view(ids[0]);
+    for(size_t i = 0; i < words.size(); ++i) {
+        if(interner.view(ids[i]) != words[i] || std::strcmp(interner.c_str(ids[i]), words[i].data()) || interner.find(ks::string(words[i])) != ids[i]) {
+            rc |= std::fprintf(stderr, "interner mismatch at %zu\n", i); break;
+        }
+    }
+    if(interner.view(ids[0]).data() != first.data()) rc |= std::fprintf(stderr, "interned view moved\n");
+    if(interner.find("absent") != kh::Interner::NONE || interner.intern("") != interner.intern(std::string_view())) rc |= std::fprintf(stderr, "interner lookup failed\n");
+
+    kh::ConcurrentInterner<4> cinterner;
+    std::vector<std::vector<kh::Interner::id_t>> cids(4);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < cids.size(); ++t) threads.emplace_back([&, t] {for(const auto &w: words) cids[t].push_back(cinterner.intern(w));});
+    for(auto &t: threads) t.join();
+    if(cinterner.size() != interner.size() - 1) rc |= std::fprintf(stderr, "concurrent interner size %zu vs %zu\n", cinterner.size(), interner.size() - 1);
+    for(size_t i = 0; i < words.size(); ++i) {
+        if(cids[0][i] != cids[3][i] || cinterner.view(cids[1][i]) != words[i]) {rc |= std::fprintf(stderr, "concurrent interner mismatch\n"); break;}
+    }
+    std::fprintf(stderr, "khtest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}
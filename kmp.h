@@ -1,7 +1,13 @@
 #pragma once
+#include "kstat.h"
+#include <algorithm>
+#include <cstddef>
 #include <type_traits>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
 
 namespace kmp {
 using std::size_t;
@@ -21,12 +27,14 @@ public:
     Pool(): cnt_(0), n_(0), max_(0), buf_(0), func_() {}
     T *malloc() {
         ++cnt_;
-        if(n_ == 0) return static_cast<T *>(std::malloc(sizeof(T)));
+        if(n_ == 0) {KSTAT_ADD(pool_misses, 1); return static_cast<T *>(std::malloc(sizeof(T)));}
+        KSTAT_ADD(pool_hits, 1);
         return buf_[--n_];
     }
     T *calloc() {
         ++cnt_;
-        if(n_ == 0) return static_cast<T *>(std::calloc(1, sizeof(T)));
+        if(n_ == 0) {KSTAT_ADD(pool_misses, 1); return static_cast<T *>(std::calloc(1, sizeof(T)));}
+        KSTAT_ADD(pool_hits, 1);
         auto ret = buf_[--n_];
         std::memset(ret, 0, sizeof(T)); // Zero memory pointed to.
         return ret;
@@ -34,7 +42,8 @@ public:
     template<typename... Args>
     T *placement_new(Args &&... args) {
         ++cnt_;
-        if(n_ == 0) return new T(std::forward<Args>(args)...);
+        if(n_ == 0) {KSTAT_ADD(pool_misses, 1); return new T(std::forward<Args>(args)...);}
+        KSTAT_ADD(pool_hits, 1);
         T *ret = buf_[n_];
         func_(ret); // This should be its destructor.
         return buf_[--n_];
@@ -56,4 +65,105 @@ public:
     }
 };
 
+class SlabPool {
+    // Fixed-size block pool. Blocks are carved from contiguous slabs which grow
+    // geometrically up to max_per_slab_ blocks; freed blocks are threaded onto an
+    // intrusive free list and reused before carving new ones.
+    // clear() and the destructor release every block in O(number of slabs).
+    // Blocks are aligned like malloc's, to alignof(std::max_align_t).
+    struct slab_t {slab_t *next;};
+    size_t elem_size_, per_slab_, max_per_slab_, used_, nslabs_;
+    char *cur_;
+    slab_t *slabs_;
+    void *free_;
+    static constexpr size_t header_size() {
+        return (sizeof(slab_t) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+    }
+    void new_slab() {
+        if(slabs_ && per_slab_ < max_per_slab_) per_slab_ = std::min(per_slab_ << 1, max_per_slab_);
+        slab_t *slab = static_cast<slab_t *>(std::malloc(header_size() + elem_size_ * per_slab_));
+        if(slab == nullptr) throw std::bad_alloc();
+        slab->next = slabs_;
+        slabs_ = slab;
+        cur_ = reinterpret_cast<char *>(slab) + header_size();
+        used_ = 0;
+        ++nslabs_;
+        KSTAT_ADD(pool_slabs, 1);
+    }
+public:
+    SlabPool(size_t elem_size, size_t min_per_slab=16, size_t max_per_slab=4096):
+        elem_size_((std::max(elem_size, sizeof(void *)) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t)),
+        per_slab_(min_per_slab ? min_per_slab: 1), max_per_slab_(std::max(max_per_slab, per_slab_)),
+        used_(0), nslabs_(0), cur_(nullptr), slabs_(nullptr), free_(nullptr) {}
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+    SlabPool(SlabPool &&o): elem_size_(o.elem_size_), per_slab_(o.per_slab_), max_per_slab_(o.max_per_slab_),
+        used_(o.used_), nslabs_(o.nslabs_), cur_(o.cur_), slabs_(o.slabs_), free_(o.free_)
+    {
+        o.slabs_ = nullptr; o.cur_ = nullptr; o.free_ = nullptr; o.used_ = o.nslabs_ = 0;
+    }
+    SlabPool &operator=(SlabPool &&o) {
+        if(this != &o) {
+            clear();
+            elem_size_ = o.elem_size_; per_slab_ = o.per_slab_; max_per_slab_ = o.max_per_slab_;
+            used_ = o.used_; nslabs_ = o.nslabs_; cur_ = o.cur_; slabs_ = o.slabs_; free_ = o.free_;
+            o.slabs_ = nullptr; o.cur_ = nullptr; o.free_ = nullptr; o.used_ = o.nslabs_ = 0;
+        }
+        return *this;
+    }
+    // Takes ownership of every slab and free block of o, which must have the same
+    // element size, leaving o empty. Blocks allocated from o remain valid and may
+    // be freed to this pool. o's partly used slab is not carved further.
+    void absorb(SlabPool &o) {
+        if(o.elem_size_ != elem_size_) throw std::invalid_argument("SlabPool::absorb requires equal element sizes.");
+        if(this == &o || o.slabs_ == nullptr) return;
+        if(slabs_ == nullptr) {
+            *this = std::move(o);
+            return;
+        }
+        // Splice o's slabs in behind our current slab, which keeps being carved.
+        slab_t *tail = o.slabs_;
+        while(tail->next) tail = tail->next;
+        tail->next = slabs_->next;
+        slabs_->next = o.slabs_;
+        if(o.free_) {
+            void *ftail = o.free_;
+            while(*static_cast<void **>(ftail)) ftail = *static_cast<void **>(ftail);
+            *static_cast<void **>(ftail) = free_;
+            free_ = o.free_;
+        }
+        nslabs_ += o.nslabs_;
+        o.slabs_ = nullptr; o.cur_ = nullptr; o.free_ = nullptr; o.used_ = o.nslabs_ = 0;
+    }
+    void *malloc() {
+        if(free_) {
+            KSTAT_ADD(pool_hits, 1);
+            void *ret = free_;
+            free_ = *static_cast<void **>(free_);
+            return ret;
+        }
+        KSTAT_ADD(pool_misses, 1);
+        if(slabs_ == nullptr || used_ == per_slab_) new_slab();
+        return cur_ + elem_size_ * used_++;
+    }
+    void *calloc() {
+        return std::memset(this->malloc(), 0, elem_size_);
+    }
+    void free(void *p) {
+        *static_cast<void **>(p) = free_;
+        free_ = p;
+    }
+    void clear() {
+        while(slabs_) {
+            slab_t *next = slabs_->next;
+            std::free(slabs_);
+            slabs_ = next;
+        }
+        cur_ = nullptr; free_ = nullptr; used_ = nslabs_ = 0;
+    }
+    size_t elem_size() const {return elem_size_;}
+    size_t nslabs()    const {return nslabs_;}
+    ~SlabPool() {clear();}
+};
+
 } // namespace kmp
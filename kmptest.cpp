@@ -1,5 +1,7 @@
 #include "kmp.h"
+#include <cstdint>
 #include <cstdio>
+#include <vector>
 
 int main() {
     kmp::Pool<int> pool;
@@ -9,4 +11,18 @@ int main() {
     i = pool.calloc();
     std::fprintf(stderr, "i: %i\n", *i);
     std::free(i);
+
+    // Every block is aligned like malloc's, whatever the element size.
+    int rc = 0;
+    for(const size_t elem_size: {1, 8, 24, 40, 100}) {
+        kmp::SlabPool slab(elem_size, 3);
+        std::vector<void *> blocks;
+        for(int k = 0; k < 50; ++k) blocks.push_back(slab.malloc());
+        for(int k = 0; k < 50; k += 2) slab.free(blocks[k]);
+        for(int k = 0; k < 50; ++k) blocks.push_back(slab.malloc());
+        for(void *p: blocks)
+            if(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t))
+                rc |= std::fprintf(stderr, "SlabPool(%zu) returned misaligned block %p\n", elem_size, p);
+    }
+    return rc != 0;
 }
@@ -12,6 +12,8 @@
 #endif
 
 #include <cstdint>
+#include "khash_fn.h"
+#include "kstat.h"
 #include <cassert>
 #include <cinttypes>
 #include <cstdarg>
@@ -23,6 +25,9 @@
 #include <string>
 #include <vector>
 #include <unistd.h>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 //#include <experimental/functional>
 // If this fails to be located and you have a new compiler, you may need to remove "experimental/" from this include.
 #include <algorithm>
@@ -139,6 +144,106 @@ static inline void *kmemmem(const void *_str, int n, const void *_pat, int m, co
     return 0;
 }
 
+/*
+ * Length-aware byte comparison. Unlike strcmp, these compare exactly n bytes,
+ * embedded NULs included, and never read beyond them.
+ * Up to 16 bytes are checked with two overlapping 8- or 4-byte loads instead of
+ * a memcmp call; longer runs go 32 or 16 bytes at a time with AVX2 or SSE2 (8-byte
+ * words otherwise) and finish with one overlapping load. Past SHORT_CMP bytes,
+ * equality and ordering call memcmp, whose runtime-dispatched vector code wins
+ * once the call overhead is amortized.
+ */
+namespace cmp_detail {
+static constexpr size_t SHORT_CMP = 32;
+static inline uint64_t load64(const char *p) {uint64_t r; std::memcpy(&r, p, 8); return r;}
+static inline uint32_t load32(const char *p) {uint32_t r; std::memcpy(&r, p, 4); return r;}
+// Index of the first differing byte, given the nonzero xor of two words loaded from memory.
+static inline unsigned first_diff(uint64_t x) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_clzll(x) >> 3;
+#else
+    return __builtin_ctzll(x) >> 3;
+#endif
+}
+static inline unsigned first_diff(uint32_t x) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_clz(x) >> 3;
+#else
+    return __builtin_ctz(x) >> 3;
+#endif
+}
+} // namespace cmp_detail
+
+// Length of the common prefix of a[0, n) and b[0, n).
+static inline size_t common_prefix_len(const char *a, const char *b, size_t n) {
+    using namespace cmp_detail;
+    if(n <= 16) {
+        if(n >= 8) {
+            uint64_t x = load64(a) ^ load64(b);
+            if(x) return first_diff(x);
+            x = load64(a + n - 8) ^ load64(b + n - 8);
+            return x ? n - 8 + first_diff(x): n;
+        }
+        if(n >= 4) {
+            uint32_t x = load32(a) ^ load32(b);
+            if(x) return first_diff(x);
+            x = load32(a + n - 4) ^ load32(b + n - 4);
+            return x ? n - 4 + first_diff(x): n;
+        }
+        size_t i = 0;
+        while(i < n && a[i] == b[i]) ++i;
+        return i;
+    }
+    size_t i = 0;
+#if defined(__AVX2__)
+    for(; i + 32 <= n; i += 32) {
+        const uint32_t ne = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)))));
+        if(ne) return i + __builtin_ctz(ne);
+    }
+#endif
+#if defined(__SSE2__)
+    auto ne16 = [a, b](size_t i) {
+        return ~unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i))))) & 0xFFFFu;
+    };
+    // Four vectors per iteration, folded into one movemask until something differs.
+    for(; i + 64 <= n; i += 64) {
+        auto eq = [a, b, i](size_t off) {
+            return _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + off)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + off)));
+        };
+        if(_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(eq(0), eq(16)), _mm_and_si128(eq(32), eq(48)))) != 0xFFFF) break;
+    }
+    for(; i + 16 <= n; i += 16) if(const unsigned ne = ne16(i)) return i + __builtin_ctz(ne);
+    // The final window overlaps bytes already known to match.
+    if(i < n) if(const unsigned ne = ne16(n - 16)) return n - 16 + __builtin_ctz(ne);
+#else
+    for(; i + 8 <= n; i += 8) if(const uint64_t x = load64(a + i) ^ load64(b + i)) return i + first_diff(x);
+    if(i < n) if(const uint64_t x = load64(a + n - 8) ^ load64(b + n - 8)) return n - 8 + first_diff(x);
+#endif
+    return n;
+}
+
+static inline bool bytes_equal(const char *a, const char *b, size_t n) {
+    using namespace cmp_detail;
+    if(n <= 16) {
+        if(n >= 8) return ((load64(a) ^ load64(b)) | (load64(a + n - 8) ^ load64(b + n - 8))) == 0;
+        if(n >= 4) return ((load32(a) ^ load32(b)) | (load32(a + n - 4) ^ load32(b + n - 4))) == 0;
+        return n == 0 || (a[0] == b[0] && a[n >> 1] == b[n >> 1] && a[n - 1] == b[n - 1]);
+    }
+    return n <= SHORT_CMP ? common_prefix_len(a, b, n) == n: std::memcmp(a, b, n) == 0;
+}
+
+// Orders by unsigned bytes, then by length, so a proper prefix sorts first.
+// Returns a negative, zero or positive value like memcmp.
+static inline int bytes_compare(const char *a, size_t alen, const char *b, size_t blen) {
+    const size_t n = std::min(alen, blen);
+    if(n <= cmp_detail::SHORT_CMP) {
+        const size_t i = common_prefix_len(a, b, n);
+        if(i < n) return int(uint8_t(a[i])) - int(uint8_t(b[i]));
+    } else if(const int c = std::memcmp(a, b, n)) return c;
+    return (alen > blen) - (alen < blen);
+}
 
 
 class string {
@@ -169,10 +274,11 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
     operator const char *() const {return s;}
 
     inline string(uint64_t used, uint64_t max, const char *str):
-        l(used), m(max)  {
+        l(used), m(std::max(max, used + 1))  {
+        // str need not be NUL-terminated, so copy used bytes and terminate here.
         if((s = static_cast<char *>(std::malloc(m * sizeof(char)))) == nullptr) throw std::bad_alloc();
-        std::memcpy(s, str, (l + 1) * sizeof(char));
-        default_allocate();
+        std::memcpy(s, str, l * sizeof(char));
+        s[l] = '\0';
     }
     inline string(char *str, size_t len): l(len), m(len), s(str) { // Stealing the other thing.
 #if !NDEBUG
@@ -217,14 +323,14 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
         return *this;
     }
     string &append(const char *str, size_t len) {
-        this->resize(this->l + len);
+        this->resize(this->l + len + 1);
         std::memcpy(this->s + this->l, str, len);
         this->l += len;
         terminate();
         return *this;
     }
     string &append(size_t n, char c) {
-        this->resize(this->l + n);
+        this->resize(this->l + n + 1);
         for(size_t final_len = this->l + n; this->l != final_len; this->s[this->l++] = c);
         terminate();
         return *this;
@@ -235,8 +341,9 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
         std::memcpy(s, other.s, l + 1);
     }
 
-    INLINE string(const std::string &str): l(str.size()), m(l), s(static_cast<char *>(std::malloc(m))) {
+    INLINE string(const std::string &str): l(str.size()), m(l + 1), s(nullptr) {
         roundup64__(m);
+        if((s = static_cast<char *>(std::malloc(m))) == nullptr) throw std::bad_alloc();
         std::memcpy(s, str.data(), (l + 1) * sizeof(char));
     }
 
@@ -258,26 +365,36 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
     INLINE auto       &len()       {return l;}
     INLINE const auto &len() const {return l;}
 
-    // Comparison functions
-    INLINE int cmp(const char *str)     const {return std::strcmp(s, str);}
-    INLINE int cmp(const string &other) const {return cmp(other.s);}
+    // Comparison functions. These cover all l bytes, embedded NULs included; see bytes_compare.
+    INLINE int cmp(const char *str, uint64_t len) const {return bytes_compare(s, l, str, len);}
+    INLINE int cmp(const char *str)               const {return cmp(str, std::strlen(str));}
+    INLINE int cmp(const string &other)           const {return cmp(other.s, other.l);}
+    template<typename T> INLINE int cmp(const T &o) const {return cmp(o.data(), o.size());}
+    uint64_t common_prefix_len(const char *str, uint64_t len) const {return ks::common_prefix_len(s, str, std::min(l, len));}
+    template<typename T> uint64_t common_prefix_len(const T &o) const {return common_prefix_len(o.data(), o.size());}
 
     INLINE bool operator==(const string &other) const {
-        return l == other.l && std::memcmp(this->s, other.s, l) == 0;
+        return l == other.l && bytes_equal(this->s, other.s, l);
     }
     INLINE bool operator==(const ::std::string &other) const {
-        return l == other.size() && std::memcmp(this->s, other.data(), l) == 0;
+        return l == other.size() && bytes_equal(this->s, other.data(), l);
     }
+    INLINE bool operator<(const string &other)  const {return cmp(other) < 0;}
+    INLINE bool operator>(const string &other)  const {return cmp(other) > 0;}
+    INLINE bool operator<=(const string &other) const {return cmp(other) <= 0;}
+    INLINE bool operator>=(const string &other) const {return cmp(other) >= 0;}
 
     void zero() {
         std::memset(this, 0, sizeof(*this));
     }
 
     INLINE bool operator==(const char *str) const {
-        return s ? str ? std::strcmp(str, s) == 0: 0: 1;
+        // str must hold exactly l bytes before its NUL; no more than l + 1 of them are read.
+        if(str == nullptr) return s == nullptr;
+        return ::strnlen(str, l + 1) == l && bytes_equal(s, str, l);
     }
 
-    template<typename T> INLINE bool operator!=(const T &o) {return !(this->operator==(o));}
+    template<typename T> INLINE bool operator!=(const T &o) const {return !(this->operator==(o));}
 
     INLINE bool palindrome() const {
         return std::equal(s, s + (l + 1) / 2, std::reverse_iterator<const char *>(s + l));
@@ -291,23 +408,31 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
         cpy.reverse();
         return cpy;
     }
-    bool startswith(const char *str, uint64_t slen) const {return std::memcmp(s, str, slen) == 0;}
+    bool startswith(const char *str, uint64_t slen) const {return slen <= l && bytes_equal(s, str, slen);}
     bool startswith(const char *str) const {return startswith(str, std::strlen(str));}
     template<typename T> bool startswith(const T &str) const {return startswith(str.data(), str.size());}
     bool endswith(const char *str, uint64_t slen) const {
-        return std::memcmp(str, s + l - slen, slen) == 0;
+        return slen <= l && bytes_equal(s + l - slen, str, slen);
     }
     bool endswith(const char *str) const {return endswith(str, std::strlen(str));}
     template<typename T> bool endswith(const T &str) const {return endswith(str.data(), str.size());}
 
+    INLINE void count_realloc(uint64_t oldm) const {
+        (void)oldm;
+        KSTAT_ADD(string_reallocs, 1);
+        KSTAT_ADD(string_growth_bytes, m - oldm);
+        KSTAT_ADD(string_copy_bytes, l);
+    }
+
     // Appending:
     INLINE int putc_(int c) {
         if (unlikely(l + 1 >= m)) {
             char *tmp;
+            const uint64_t oldm = m;
             m = l + 2;
             roundup64__(m);
             if ((tmp = static_cast<char *>(std::realloc(s, m * sizeof(char)))))
-                s = tmp;
+                s = tmp, count_realloc(oldm);
             else
                 return EOF;
         }
@@ -323,10 +448,11 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
         if (c < 0) buf[len++] = '-';
         if (unlikely(len + l + 1 >= m)) {
             char *tmp;
+            const uint64_t oldm = m;
             m = len + l + 2;
             roundup64__(m);
             if ((tmp = static_cast<char*>(std::realloc(s, m * sizeof(char)))))
-                s = tmp;
+                s = tmp, count_realloc(oldm);
             else
                 return EOF;
         }
@@ -341,10 +467,11 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
         for (len = 0, x = c; x > 0; x /= 10) buf[len++] = (char)(x%10 + '0');
         if (unlikely(len + l + 1 >= m)) {
             char *tmp;
+            const uint64_t oldm = m;
             m = len + l + 2;
             roundup64__(m);
             if ((tmp = static_cast<char *>(std::realloc(s, m * sizeof(char)))))
-                s = tmp;
+                s = tmp, count_realloc(oldm);
             else
                 return EOF;
         }
@@ -360,10 +487,11 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
         if (c < 0) buf[len++] = '-';
         if (unlikely(len + l + 1 >= m)) {
             char *tmp;
+            const uint64_t oldm = m;
             m = len + l + 2;
             roundup64__(m);
             if ((tmp = static_cast<char *>(std::realloc(s, m * sizeof(char)))))
-                s = tmp;
+                s = tmp, count_realloc(oldm);
             else
                 return EOF;
         }
@@ -373,10 +501,11 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
     INLINE long putsn_(const char *str, long len) {
         if (unlikely(len + l + 1 >= m)) {
             char *tmp;
+            const uint64_t oldm = m;
             m = len + l + 2;
             roundup64__(m);
             if ((tmp = static_cast<char *>(std::realloc(s, m * sizeof(char)))))
-                s = tmp;
+                s = tmp, count_realloc(oldm);
             else
                 return EOF;
         }
@@ -471,6 +600,7 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
     INLINE int resize(uint64_t size) {
         if (m < size) {
             char *tmp;
+            const uint64_t oldm = m;
             m = std::max(size, UINT64_C(4));
             roundup64__(m);
             if ((tmp = static_cast<char*>(std::realloc(s, m * sizeof(char)))) == nullptr) {
@@ -478,6 +608,7 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
                 throw std::bad_alloc();
             }
             s = tmp;
+            count_realloc(oldm);
         }
         return 0;
     }
@@ -490,8 +621,15 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
     INLINE auto &operator+=(int c)        {putw(c);  return *this;}
     INLINE auto &operator+=(unsigned c)   {putuw(c); return *this;}
     INLINE auto &operator+=(long c)       {putl(c);  return *this;}
+    INLINE void count_search(const char *hit, uint64_t len) const {
+        (void)hit; (void)len;
+        KSTAT_ADD(search_calls, 1);
+        KSTAT_ADD(search_bytes, hit && hit != s + l ? uint64_t(hit - s) + len: l);
+    }
     char *locate(const char *str, uint64_t len) {
-        return (char *)memmem(s, l, str, len);
+        char *ret = (char *)memmem(s, l, str, len);
+        count_search(ret, len);
+        return ret;
     }
     const char *locate(const char *str, uint64_t len) const {return static_cast<const char *>(const_cast<string *>(this)->locate(str, len));}
     const char *locate(const char *str) const {return locate(str, std::strlen(str));}
@@ -500,20 +638,26 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
     char *bmlocate(const char *str, uint64_t len) {
 #if __cpp_lib_boyer_moore_searcher
         std::boyer_moore_searcher searcher(str, str + len);
-        return std::search<const char *, decltype(searcher)>(s, s + l, searcher);
+        char *ret = std::search<const char *, decltype(searcher)>(s, s + l, searcher);
+        if(ret == s + l && len) ret = nullptr; // Misses are nullptr, as from memmem and kmemmem.
 #else
         auto prep = ksBM_prep((const ::std::uint8_t *)str, len);
-        return (char *)kmemmem((const ::std::uint8_t *)s, l, (const ::std::uint8_t *)str, len, prep);
+        char *ret = (char *)kmemmem((const ::std::uint8_t *)s, l, (const ::std::uint8_t *)str, len, prep);
 #endif
+        count_search(ret, len);
+        return ret;
     }
     char *bmhlocate(const char *str, uint64_t len) {
 #if __cpp_lib_boyer_moore_searcher
         std::boyer_moore_horspool_searcher searcher(str, str + len);
-        return std::search(s, s + l, searcher);
+        char *ret = std::search(s, s + l, searcher);
+        if(ret == s + l && len) ret = nullptr;
 #else
         auto prep = ksBM_prep((const ::std::uint8_t *)str, len);
-        return (char *)kmemmem(s, l, str, len, prep);
+        char *ret = (char *)kmemmem(s, l, str, len, prep);
 #endif
+        count_search(ret, len);
+        return ret;
     }
 #if __cpp_lib_boyer_moore_searcher
     auto make_bm() const {
@@ -533,7 +677,7 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
     bool contains(const char *str) const {return contains(str, std::strlen(str));}
     template<typename T> bool contains(const T &str) const {return contains(str.data(), str.size());}
     bool bmcontains(const char *str, uint64_t len) const {
-        return bmlocate(str, len) != end();
+        return bmlocate(str, len) != nullptr;
     }
     bool bmcontains(const char *str) const {return bmcontains(str, std::strlen(str));}
     template<typename T> bool bmcontains(const T &str) const {return bmcontains(str.data(), str.size());}
@@ -561,8 +705,8 @@ TODO: Add SSO to avoid allocating for small strings, which we currently do
 
     INLINE size_t write(FILE *fp) const   {return std::fwrite(s, sizeof(char), l, fp);}
     INLINE auto write(const char *path) const {
-        std::FILE *fp(std::fopen(path, "r"));
-        if(!fp) throw 1;
+        std::FILE *fp(std::fopen(path, "w"));
+        if(!fp) throw std::runtime_error("Could not open "s + path + " for writing.");
         const auto ret(write(fp));
         std::fclose(fp);
         return ret;
@@ -620,7 +764,7 @@ inline std::vector<T, Alloc> split(char *s, uint64_t l, int delimiter=0)
     return ret;
 }
 
-static string sprintf(const char *fmt, ...) {
+inline string sprintf(const char *fmt, ...) {
     string ret;
     va_list ap;
     va_start(ap, fmt);
@@ -651,6 +795,12 @@ using KString = ks::string;
 
 using ks::KString;
 
+namespace std {
+template<> struct hash<ks::string> {
+    size_t operator()(const ks::string &s) const {return kh::hash(s.data(), s.size());}
+};
+} // namespace std
+
 #undef roundup64__
 
 #endif // #ifndef _KS_WRAPPER_H__
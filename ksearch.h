@@ -0,0 +1,211 @@
+#ifndef KSEARCH_H__
+#define KSEARCH_H__
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Approximate substring search over ks::string or any byte buffer.
+ *
+ * ks::MyersSearcher finds occurrences within edit distance k using Myers'
+ * bit-vector algorithm (J. ACM 46(3), 1999), with the pattern split across as many
+ * 64-bit words as it needs. Hits are reported by end position, since an
+ * approximate match has no single start.
+ * ks::HammingSearcher finds occurrences with at most k mismatches, comparing 32,
+ * 16 or 8 bytes at a time with AVX2, SSE2 or SWAR and abandoning an alignment
+ * as soon as it exceeds k.
+ *
+ * Both build their tables once per pattern and may be reused over many texts,
+ * including from several threads at once.
+ */
+
+namespace ks {
+
+namespace search_detail {
+// Without hardware popcount, __builtin_popcount is a library call.
+static inline unsigned popcount(uint64_t x) {
+#ifdef __POPCNT__
+    return __builtin_popcountll(x);
+#else
+    x -= (x >> 1) & 0x5555555555555555ULL;
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    return unsigned((((x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL) * 0x0101010101010101ULL) >> 56);
+#endif
+}
+} // namespace search_detail
+
+struct search_hit_t {
+    size_t pos;  // MyersSearcher: index of the last matched text byte. HammingSearcher: index of the first.
+    int dist;
+};
+
+class MyersSearcher {
+    std::vector<uint64_t> peq_; // peq_[c * nwords_ + w]: bit i set if pattern[64 * w + i] == c.
+    size_t m_, nwords_;
+    uint64_t last_bit_;
+
+    // Advances one 64-row block of vertical deltas (pv, mv) by a text column, given the
+    // horizontal delta entering its top; returns the delta leaving its bottom.
+    static int advance_block(uint64_t &pv, uint64_t &mv, uint64_t eq, int hin, uint64_t high) {
+        const uint64_t xv = eq | mv;
+        if(hin < 0) eq |= 1;
+        const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv), mh = pv & xh;
+        const int hout = (ph & high) ? 1: (mh & high) ? -1: 0;
+        ph <<= 1; mh <<= 1;
+        if(hin < 0) mh |= 1;
+        else if(hin > 0) ph |= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        return hout;
+    }
+
+public:
+    MyersSearcher(const char *pattern, size_t m): m_(m), nwords_((m + 63) / 64) {
+        if(m == 0) throw std::invalid_argument("MyersSearcher requires a non-empty pattern.");
+        peq_.assign(256 * nwords_, 0);
+        for(size_t i = 0; i < m; ++i) peq_[uint8_t(pattern[i]) * nwords_ + i / 64] |= uint64_t(1) << (i % 64);
+        last_bit_ = uint64_t(1) << ((m - 1) % 64);
+    }
+    MyersSearcher(const char *pattern): MyersSearcher(pattern, std::strlen(pattern)) {}
+    template<typename T>
+    MyersSearcher(const T &pattern): MyersSearcher(reinterpret_cast<const char *>(pattern.data()), pattern.size()) {}
+
+    size_t size() const {return m_;}
+
+    // Calls func(end, dist) for every end position whose best alignment has dist <= k.
+    template<typename Func>
+    void search(const char *text, size_t n, int k, const Func &func) const {
+        int score = int(m_);
+        if(nwords_ == 1) {
+            uint64_t pv = ~uint64_t(0), mv = 0;
+            for(size_t j = 0; j < n; ++j) {
+                score += advance_block(pv, mv, peq_[uint8_t(text[j])], 0, last_bit_);
+                if(score <= k) func(j, score);
+            }
+            return;
+        }
+        std::vector<uint64_t> pv(nwords_, ~uint64_t(0)), mv(nwords_, 0);
+        const size_t last = nwords_ - 1;
+        for(size_t j = 0; j < n; ++j) {
+            const uint64_t *eqs = peq_.data() + uint8_t(text[j]) * nwords_;
+            int h = 0; // Row 0 is all zeros: a match may start anywhere.
+            for(size_t w = 0; w < last; ++w) h = advance_block(pv[w], mv[w], eqs[w], h, uint64_t(1) << 63);
+            score += advance_block(pv[last], mv[last], eqs[last], h, last_bit_);
+            if(score <= k) func(j, score);
+        }
+    }
+    template<typename T, typename Func>
+    void search(const T &text, int k, const Func &func) const {search(text.data(), text.size(), k, func);}
+
+    std::vector<search_hit_t> find_all(const char *text, size_t n, int k) const {
+        std::vector<search_hit_t> ret;
+        search(text, n, k, [&ret](size_t pos, int dist) {ret.push_back(search_hit_t{pos, dist});});
+        return ret;
+    }
+    template<typename T>
+    std::vector<search_hit_t> find_all(const T &text, int k) const {return find_all(text.data(), text.size(), k);}
+
+    // The leftmost end position with the smallest edit distance; dist is m if n is 0.
+    search_hit_t best(const char *text, size_t n) const {
+        search_hit_t ret{0, int(m_)};
+        search(text, n, int(m_) - 1, [&ret](size_t pos, int dist) {if(dist < ret.dist) ret = search_hit_t{pos, dist};});
+        return ret;
+    }
+    template<typename T>
+    search_hit_t best(const T &text) const {return best(text.data(), text.size());}
+};
+
+class HammingSearcher {
+    std::vector<char> pattern_;
+
+    static unsigned swar_mismatches(uint64_t a, uint64_t b) {
+        // High bit of each byte of t is set where a and b agree.
+        constexpr uint64_t LOW7 = 0x7F7F7F7F7F7F7F7FULL;
+        const uint64_t x = a ^ b;
+        const uint64_t t = ~(((x & LOW7) + LOW7) | x | LOW7);
+        return 8 - unsigned(((t >> 7) * 0x0101010101010101ULL) >> 56);
+    }
+    // Mismatches between s and the pattern, or any value > k once it exceeds k.
+    unsigned mismatches(const char *s, unsigned k) const {
+        const char *p = pattern_.data();
+        const size_t m = pattern_.size();
+        unsigned ret = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        for(; i + 32 <= m; i += 32) {
+            const __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i)),
+                                                 _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i)));
+            if((ret += 32 - search_detail::popcount(uint32_t(_mm256_movemask_epi8(eq)))) > k) return ret;
+        }
+#endif
+#if defined(__SSE2__)
+        for(; i + 16 <= m; i += 16) {
+            const __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i)),
+                                              _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i)));
+            if((ret += 16 - search_detail::popcount(unsigned(_mm_movemask_epi8(eq)))) > k) return ret;
+        }
+#endif
+        for(; i + 8 <= m; i += 8) {
+            uint64_t a, b;
+            std::memcpy(&a, s + i, 8); std::memcpy(&b, p + i, 8);
+            if((ret += swar_mismatches(a, b)) > k) return ret;
+        }
+        for(; i < m; ++i) ret += s[i] != p[i];
+        return ret;
+    }
+
+public:
+    HammingSearcher(const char *pattern, size_t m): pattern_(pattern, pattern + m) {
+        if(m == 0) throw std::invalid_argument("HammingSearcher requires a non-empty pattern.");
+    }
+    HammingSearcher(const char *pattern): HammingSearcher(pattern, std::strlen(pattern)) {}
+    template<typename T>
+    HammingSearcher(const T &pattern): HammingSearcher(reinterpret_cast<const char *>(pattern.data()), pattern.size()) {}
+
+    size_t size() const {return pattern_.size();}
+
+    // Calls func(start, dist) for every alignment with at most k mismatches.
+    template<typename Func>
+    void search(const char *text, size_t n, int k, const Func &func) const {
+        if(k < 0 || n < pattern_.size()) return;
+        for(size_t i = 0, e = n - pattern_.size(); i <= e; ++i) {
+            const unsigned d = mismatches(text + i, unsigned(k));
+            if(d <= unsigned(k)) func(i, int(d));
+        }
+    }
+    template<typename T, typename Func>
+    void search(const T &text, int k, const Func &func) const {search(text.data(), text.size(), k, func);}
+
+    std::vector<search_hit_t> find_all(const char *text, size_t n, int k) const {
+        std::vector<search_hit_t> ret;
+        search(text, n, k, [&ret](size_t pos, int dist) {ret.push_back(search_hit_t{pos, dist});});
+        return ret;
+    }
+    template<typename T>
+    std::vector<search_hit_t> find_all(const T &text, int k) const {return find_all(text.data(), text.size(), k);}
+
+    // The leftmost alignment with the fewest mismatches; dist is -1 if the text is shorter than the pattern.
+    // The bound tightens as better hits are found, so later alignments are abandoned earlier.
+    search_hit_t best(const char *text, size_t n) const {
+        search_hit_t ret{0, -1};
+        if(n < pattern_.size()) return ret;
+        ret.dist = int(mismatches(text, unsigned(pattern_.size())));
+        for(size_t i = 1, e = n - pattern_.size(); i <= e && ret.dist; ++i) {
+            const unsigned d = mismatches(text + i, unsigned(ret.dist - 1));
+            if(d < unsigned(ret.dist)) ret = search_hit_t{i, int(d)};
+        }
+        return ret;
+    }
+    template<typename T>
+    search_hit_t best(const T &text) const {return best(text.data(), text.size());}
+};
+
+} // namespace ks
+
+#endif
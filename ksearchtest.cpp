@@ -0,0 +1,63 @@
+#include "ks.h"
+#include "ksearch.h"
+#include <random>
+#include <string>
+
+// Smallest edit distance of pattern against any substring of text ending at each position.
+static std::vector<int> naive_edit(const std::string &p, const std::string &t) {
+    std::vector<int> col(p.size() + 1), ret;
+    for(size_t i = 0; i <= p.size(); ++i) col[i] = i;
+    for(const char c: t) {
+        int diag = 0;
+        col[0] = 0;
+        for(size_t i = 1; i <= p.size(); ++i) {
+            const int up = col[i];
+            col[i] = std::min({up + 1, col[i - 1] + 1, diag + (p[i - 1] != c)});
+            diag = up;
+        }
+        ret.push_back(col.back());
+    }
+    return ret;
+}
+
+int main() {
+    int rc = 0;
+    std::mt19937_64 mt(19);
+    auto random_dna = [&mt](size_t len) {std::string s(len, 0); for(auto &c: s) c = "ACGT"[mt() % 4]; return s;};
+    for(const size_t m: {1, 7, 63, 64, 65, 150}) {
+        const ks::string text(random_dna(2000));
+        std::string pattern = random_dna(m);
+        // Plant a copy with a couple of substitutions.
+        std::string planted = pattern;
+        if(m > 4) planted[m / 2] = planted[m / 2] == 'A' ? 'C': 'A';
+        std::string t(text.data(), text.size());
+        t.replace(500, m, planted);
+        const ks::string kt(t);
+
+        const auto expected = naive_edit(pattern, t);
+        const ks::MyersSearcher myers(pattern);
+        const int k = int(m / 4);
+        std::vector<int> got(t.size(), -1);
+        myers.search(kt, k, [&](size_t pos, int dist) {got[pos] = dist;});
+        for(size_t j = 0; j < t.size(); ++j) {
+            if((expected[j] <= k ? expected[j]: -1) != got[j]) {rc |= std::fprintf(stderr, "myers m=%zu mismatch at %zu\n", m, j); break;}
+        }
+        const auto best = myers.best(kt);
+        if(best.dist != *std::min_element(expected.begin(), expected.end()) || expected[best.pos] != best.dist)
+            rc |= std::fprintf(stderr, "myers best m=%zu\n", m);
+
+        const ks::HammingSearcher ham(pattern);
+        std::vector<int> hgot(t.size(), -1);
+        ham.search(kt, k, [&](size_t pos, int dist) {hgot[pos] = dist;});
+        int hbest = int(m) + 1;
+        for(size_t i = 0; i + m <= t.size(); ++i) {
+            int d = 0;
+            for(size_t j = 0; j < m; ++j) d += t[i + j] != pattern[j];
+            hbest = std::min(hbest, d);
+            if((d <= k ? d: -1) != hgot[i]) {rc |= std::fprintf(stderr, "hamming m=%zu mismatch at %zu\n", m, i); break;}
+        }
+        if(ham.best(kt).dist != hbest) rc |= std::fprintf(stderr, "hamming best m=%zu\n", m);
+    }
+    std::fprintf(stderr, "ksearchtest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}
@@ -0,0 +1,177 @@
+#ifndef KSORT_H__
+#define KSORT_H__
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * String sorting for ks::string, std::string, std::string_view or anything else
+ * with byte data() and size().
+ * Elements are reduced to records holding the next 8 key bytes as a big-endian
+ * integer, so most comparisons are a single integer compare without touching the
+ * string. Records are sorted by multikey quicksort on those cached words,
+ * reloading 8 bytes deeper for groups which tie, then the elements are permuted
+ * by moving them once. A key level whose partitions keep degenerating is finished
+ * by std::sort. Large partitions are sorted on additional threads.
+ * Order is by unsigned bytes (memcmp), with a proper prefix sorting first.
+ * The sort is not stable.
+ */
+
+namespace ks {
+
+namespace sort_detail {
+
+struct rec_t {
+    uint64_t key;    // Bytes [depth, depth + 8) of the string, zero-padded.
+    const char *s;
+    size_t len;
+    size_t idx;
+};
+
+static inline uint64_t load_key(const char *s, size_t len, size_t depth) {
+    if(len >= depth + 8) {
+        uint64_t ret;
+        std::memcpy(&ret, s + depth, 8);
+        return __builtin_bswap64(ret);
+    }
+    uint64_t ret = 0;
+    for(size_t i = depth; i < len; ++i) ret |= uint64_t(uint8_t(s[i])) << (8 * (7 - (i - depth)));
+    return ret;
+}
+
+// Full comparison of two records whose keys were loaded at depth.
+static inline bool less(const rec_t &a, const rec_t &b, size_t depth) {
+    if(a.key != b.key) return a.key < b.key;
+    const size_t off = depth + 8;
+    const size_t alen = a.len > off ? a.len - off: 0, blen = b.len > off ? b.len - off: 0;
+    const size_t n = std::min(alen, blen);
+    const int c = n ? std::memcmp(a.s + off, b.s + off, n): 0;
+    return c ? c < 0: a.len < b.len;
+}
+
+class Sorter {
+    static constexpr size_t INSERTION_THRESHOLD = 16, PARALLEL_THRESHOLD = size_t(1) << 15;
+    std::atomic<unsigned> spare_threads_;
+
+    static void insertion_sort(rec_t *r, size_t n, size_t depth) {
+        for(size_t i = 1; i < n; ++i) {
+            rec_t tmp = r[i];
+            size_t j = i;
+            for(; j && less(tmp, r[j - 1], depth); --j) r[j] = r[j - 1];
+            r[j] = tmp;
+        }
+    }
+    static uint64_t median3(uint64_t a, uint64_t b, uint64_t c) {
+        return a < b ? (b < c ? b: a < c ? c: a): (a < c ? a: b < c ? c: b);
+    }
+    // Runs func on another thread if one is spare, otherwise inline. Returns the thread, if any.
+    template<typename Func>
+    std::thread maybe_spawn(size_t n, const Func &func) {
+        if(n >= PARALLEL_THRESHOLD) {
+            unsigned spare = spare_threads_.load(std::memory_order_relaxed);
+            while(spare && !spare_threads_.compare_exchange_weak(spare, spare - 1, std::memory_order_relaxed));
+            if(spare) return std::thread([this, func] {func(); spare_threads_.fetch_add(1, std::memory_order_relaxed);});
+        }
+        func();
+        return std::thread();
+    }
+
+    static unsigned depth_budget(size_t n) {return 2 * (64 - __builtin_clzll(n | 1));}
+
+public:
+    Sorter(unsigned nthreads): spare_threads_(nthreads ? nthreads - 1: 0) {}
+
+    void sort(rec_t *r, size_t n, size_t depth) {sort(r, n, depth, depth_budget(n));}
+    // Each partition step recurses (possibly on another thread) into the two smaller parts and loops
+    // on the largest, so the stack stays O(log n). If pivots keep coming out lopsided the budget runs
+    // out and the rest of this key level falls back to std::sort, as in introsort.
+    void sort(rec_t *r, size_t n, size_t depth, unsigned budget) {
+        struct part_t {rec_t *r; size_t n, depth; unsigned budget;};
+        std::vector<std::thread> threads;
+        for(;;) {
+            if(n < INSERTION_THRESHOLD) {insertion_sort(r, n, depth); break;}
+            if(budget-- == 0) {
+                std::sort(r, r + n, [depth](const rec_t &a, const rec_t &b) {return less(a, b, depth);});
+                break;
+            }
+            const uint64_t pivot = median3(r[0].key, r[n >> 1].key, r[n - 1].key);
+            // Three-way partition on the cached key: [0, lt) < pivot, [lt, gt) == pivot, [gt, n) > pivot.
+            size_t lt = 0, i = 0, gt = n;
+            while(i < gt) {
+                if(r[i].key < pivot)      std::swap(r[lt++], r[i++]);
+                else if(r[i].key > pivot) std::swap(r[i], r[--gt]);
+                else ++i;
+            }
+            // Equal keys: strings ending within these 8 bytes are prefixes of the rest and order by length.
+            rec_t *eq = r + lt, *eq_end = r + gt;
+            const size_t off = depth + 8;
+            rec_t *mid = std::partition(eq, eq_end, [off](const rec_t &x) {return x.len <= off;});
+            std::sort(eq, mid, [](const rec_t &a, const rec_t &b) {return a.len < b.len;});
+            for(rec_t *p = mid; p < eq_end; ++p) p->key = load_key(p->s, p->len, off);
+            // The rest of the equal group starts a new key level with a fresh budget.
+            const size_t nrest = eq_end - mid;
+            const part_t parts[3] = {{r, lt, depth, budget}, {eq_end, n - gt, depth, budget}, {mid, nrest, off, depth_budget(nrest)}};
+            const part_t *big = std::max_element(parts, parts + 3, [](const part_t &a, const part_t &b) {return a.n < b.n;});
+            for(const part_t &p: parts) {
+                if(&p == big || p.n < 2) continue;
+                std::thread t = maybe_spawn(p.n, [this, p] {sort(p.r, p.n, p.depth, p.budget);});
+                if(t.joinable()) threads.push_back(std::move(t));
+            }
+            r = big->r; n = big->n; depth = big->depth; budget = big->budget;
+        }
+        for(auto &t: threads) t.join();
+    }
+};
+
+template<typename T>
+const char *data_of(const T &x) {return reinterpret_cast<const char *>(x.data());}
+
+} // namespace sort_detail
+
+// Sorts [first, last) by byte order using up to nthreads threads (0 uses all hardware threads).
+// It must be a random-access iterator.
+template<typename It>
+void sort_strings(It first, It last, unsigned nthreads=1) {
+    using value_type = typename std::iterator_traits<It>::value_type;
+    static_assert(std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>::value,
+                  "sort_strings requires random-access iterators");
+    using namespace sort_detail;
+    const size_t n = std::distance(first, last);
+    if(n < 2) return;
+    if(nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<rec_t> recs(n);
+    It it = first;
+    for(size_t i = 0; i < n; ++i, ++it) {
+        const char *s = data_of(*it);
+        const size_t len = it->size();
+        recs[i] = rec_t{load_key(s, len, 0), s, len, i};
+    }
+    Sorter(nthreads).sort(recs.data(), n, 0);
+    std::vector<value_type> tmp;
+    tmp.reserve(n);
+    for(const auto &r: recs) tmp.emplace_back(std::move(first[r.idx]));
+    std::move(tmp.begin(), tmp.end(), first);
+}
+template<typename Container>
+void sort_strings(Container &c, unsigned nthreads=1) {sort_strings(std::begin(c), std::end(c), nthreads);}
+
+// Sorts c and removes duplicates, returning the number of distinct elements.
+template<typename Container>
+size_t sort_unique(Container &c, unsigned nthreads=1) {
+    sort_strings(c, nthreads);
+    auto end = std::unique(std::begin(c), std::end(c), [](const auto &a, const auto &b) {
+        return a.size() == b.size() && (a.size() == 0 || std::memcmp(a.data(), b.data(), a.size()) == 0);
+    });
+    c.erase(end, std::end(c));
+    return c.size();
+}
+
+} // namespace ks
+
+#endif
@@ -0,0 +1,60 @@
+#include "ks.h"
+#include "ksort.h"
+#include <random>
+#include <string>
+#include <string_view>
+
+int main() {
+    int rc = 0;
+    std::mt19937_64 mt(17);
+    // Short alphabets and shared prefixes exercise ties at every depth, including embedded NULs.
+    std::vector<std::string> ref;
+    for(size_t i = 0; i < 200000; ++i) {
+        std::string s(mt() % 3 ? "common_prefix_": "");
+        const size_t len = mt() % 24;
+        for(size_t j = 0; j < len; ++j) s += "ab\0\xff"[mt() % 4];
+        ref.push_back(s);
+    }
+    const std::vector<std::string> input(ref);
+    std::vector<ks::string> strs(input.begin(), input.end());
+    std::vector<std::string_view> views(input.begin(), input.end());
+    std::sort(ref.begin(), ref.end());
+    ks::sort_strings(strs, 4);
+    ks::sort_strings(views.begin(), views.end());
+    for(size_t i = 0; i < ref.size(); ++i) {
+        if(std::string_view(strs[i].data(), strs[i].size()) != ref[i] || views[i] != ref[i]) {
+            rc |= std::fprintf(stderr, "order mismatch at %zu\n", i);
+            break;
+        }
+    }
+    // Presorted, reversed, organ-pipe and constant-key inputs, which skew the partitions.
+    std::vector<std::string> skewed;
+    for(size_t i = 0; i < 100000; ++i) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%016zu", i < 50000 ? i: 100000 - i);
+        skewed.push_back(buf);
+    }
+    std::vector<std::vector<std::string>> patterns{skewed, skewed, skewed, std::vector<std::string>(50000, std::string(20, 'x'))};
+    std::sort(patterns[1].begin(), patterns[1].end());
+    std::sort(patterns[2].rbegin(), patterns[2].rend());
+    for(auto &p: patterns) {
+        auto expected = p;
+        std::sort(expected.begin(), expected.end());
+        ks::sort_strings(p, 2);
+        if(p != expected) rc |= std::fprintf(stderr, "skewed input order mismatch\n");
+    }
+    // An exhausted depth budget finishes with std::sort and must give the same order.
+    std::vector<ks::sort_detail::rec_t> recs;
+    for(size_t i = 0; i < input.size(); ++i) recs.push_back({ks::sort_detail::load_key(input[i].data(), input[i].size(), 0), input[i].data(), input[i].size(), i});
+    ks::sort_detail::Sorter(1).sort(recs.data(), recs.size(), 0, 1);
+    for(size_t i = 0; i < recs.size(); ++i) {
+        if(std::string_view(recs[i].s, recs[i].len) != ref[i]) {
+            rc |= std::fprintf(stderr, "fallback order mismatch at %zu\n", i);
+            break;
+        }
+    }
+    const size_t nunique = ks::sort_unique(strs, 4);
+    if(nunique != size_t(std::unique(ref.begin(), ref.end()) - ref.begin())) rc |= std::fprintf(stderr, "sort_unique returned %zu\n", nunique);
+    std::fprintf(stderr, "ksorttest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}
@@ -0,0 +1,253 @@
+#ifndef KSPARSE_H__
+#define KSPARSE_H__
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Locale-independent numeric field parsing over (pointer, length) fields, such as
+ * those produced by ks::split.
+ *
+ * Integers are parsed eight digits at a time with SWAR. Doubles with at most 19
+ * significant digits and a small decimal exponent are computed exactly in one
+ * multiplication or division (Clinger's fast path); anything else, including
+ * inf and nan, falls back to std::from_chars, which is correctly rounded.
+ * A field must be consumed entirely: no surrounding whitespace or trailing bytes.
+ *
+ * ks::parse_columns reads a whole buffer of delimited lines into typed column
+ * vectors in one pass, recording bad fields instead of stopping at the first.
+ */
+
+namespace ks {
+
+// underflow: the value is too small to represent and rounds to zero; out is set to
+// a zero of the right sign, which callers may accept.
+enum class parse_status: uint8_t {ok, empty, invalid, overflow, missing, underflow};
+
+inline const char *parse_status_str(parse_status s) {
+    switch(s) {
+        case parse_status::ok:       return "ok";
+        case parse_status::empty:    return "empty field";
+        case parse_status::invalid:  return "invalid number";
+        case parse_status::overflow: return "out of range";
+        case parse_status::missing:  return "missing field";
+        case parse_status::underflow: return "underflows to zero";
+    }
+    return "unknown";
+}
+
+namespace parse_detail {
+
+// From fast_float (Lemire et al.): all 8 bytes are ASCII digits.
+static inline bool is_8digits(uint64_t x) {
+    return ((x & 0xF0F0F0F0F0F0F0F0ULL) | (((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+// Value of 8 ASCII digits loaded little-endian.
+static inline uint32_t parse_8digits(uint64_t x) {
+    constexpr uint64_t MASK = 0x000000FF000000FFULL, MUL1 = 100 + (1000000ULL << 32), MUL2 = 1 + (10000ULL << 32);
+    x -= 0x3030303030303030ULL;
+    x = x * 10 + (x >> 8);
+    return uint32_t((((x & MASK) * MUL1) + (((x >> 16) & MASK) * MUL2)) >> 32);
+}
+static inline bool is_digit(char c) {return unsigned(c - '0') < 10;}
+
+// Accumulates the digit run at p into v, returning the end of the run.
+// overflow is set if the value does not fit in 64 bits.
+static inline const char *parse_digits(const char *p, const char *end, uint64_t &v, bool &overflow) {
+    while(p < end && *p == '0') ++p;
+    const char *sig = p;
+    v = 0;
+    // Up to 16 digits cannot overflow, so take them eight at a time unchecked.
+    for(uint64_t x; end - p >= 8 && p - sig <= 8; p += 8) {
+        std::memcpy(&x, p, 8);
+        if(!is_8digits(x)) break;
+        v = v * 100000000 + parse_8digits(x);
+    }
+    for(; p < end && is_digit(*p); ++p) {
+        if(p - sig < 19) v = v * 10 + (*p - '0');
+        else overflow |= __builtin_mul_overflow(v, 10, &v) | __builtin_add_overflow(v, uint64_t(*p - '0'), &v);
+    }
+    return p;
+}
+
+static constexpr double POW10[] {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+} // namespace parse_detail
+
+template<typename T, typename=std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value>>
+inline parse_status parse(const char *p, size_t len, T &out) {
+    using namespace parse_detail;
+    const char *end = p + len;
+    if(len == 0) return parse_status::empty;
+    bool neg = false;
+    if(*p == '-' || *p == '+') {
+        neg = *p == '-';
+        if(neg && !std::is_signed<T>::value) return parse_status::invalid;
+        ++p;
+    }
+    if(p == end || !is_digit(*p)) return parse_status::invalid;
+    uint64_t v;
+    bool overflow = false;
+    if(parse_digits(p, end, v, overflow) != end) return parse_status::invalid;
+    using U = std::make_unsigned_t<T>;
+    const uint64_t limit = neg ? uint64_t(std::numeric_limits<T>::max()) + 1: uint64_t(std::numeric_limits<T>::max());
+    if(overflow || v > limit) return parse_status::overflow;
+    out = neg ? T(U(0) - U(v)): T(v);
+    return parse_status::ok;
+}
+
+inline parse_status parse(const char *p, size_t len, double &out) {
+    using namespace parse_detail;
+    const char *const start = p, *const end = p + len;
+    if(len == 0) return parse_status::empty;
+    // tiny: the magnitude is below 1, so a range error means underflow rather than overflow.
+    auto fallback = [start, end, &out](bool tiny) {
+        // from_chars rejects a leading '+', and handles the sign of everything else itself.
+        const char *f = start + (*start == '+');
+        const auto res = std::from_chars(f, end, out);
+        if(res.ec == std::errc::result_out_of_range) {
+            if(!tiny) return parse_status::overflow;
+            out = *start == '-' ? -0.: 0.;
+            return parse_status::underflow;
+        }
+        if(res.ec != std::errc() || res.ptr != end || (f != start && *f == '-')) return parse_status::invalid;
+        return parse_status::ok;
+    };
+    const bool neg = *p == '-';
+    if(*p == '-' || *p == '+') ++p;
+    // Fast path: at most 19 significant digits.
+    uint64_t m = 0;
+    int64_t exp10 = 0;
+    int ndigits = 0;
+    const char *q = p;
+    while(q < end && *q == '0') ++q;
+    for(; q < end && is_digit(*q); ++q, ++ndigits) m = m * 10 + (*q - '0');
+    bool any = q != p;
+    if(q < end && *q == '.') {
+        const char *frac = ++q;
+        if(m == 0) while(q < end && *q == '0') ++q;
+        exp10 -= q - frac;
+        const char *fd = q;
+        for(; q < end && is_digit(*q); ++q, ++ndigits) m = m * 10 + (*q - '0');
+        exp10 -= q - fd;
+        any |= q != frac;
+    }
+    if(!any) return fallback(false);
+    if(q < end && (*q == 'e' || *q == 'E')) {
+        ++q;
+        bool eneg = false;
+        if(q < end && (*q == '-' || *q == '+')) eneg = *q++ == '-';
+        if(q == end || !is_digit(*q)) return parse_status::invalid;
+        int64_t e = 0;
+        for(; q < end && is_digit(*q); ++q) if(e < 100000) e = e * 10 + (*q - '0');
+        exp10 += eneg ? -e: e;
+    }
+    if(q != end) return parse_status::invalid;
+    if(ndigits <= 19) {
+        if(m == 0) {out = neg ? -0.: 0.; return parse_status::ok;}
+        if(m <= (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+            double d = double(m);
+            d = exp10 < 0 ? d / POW10[-exp10]: d * POW10[exp10];
+            out = neg ? -d: d;
+            return parse_status::ok;
+        }
+    }
+    // m holds ndigits significant digits, so the value is below 1 when ndigits + exp10 <= 0.
+    return fallback(ndigits + exp10 <= 0);
+}
+
+template<typename T>
+inline parse_status parse(const char *s, T &out) {return parse(s, std::strlen(s), out);}
+template<typename S, typename T, typename=decltype(std::declval<const S &>().size())>
+inline parse_status parse(const S &s, T &out) {return parse(s.data(), s.size(), out);}
+
+// Parses each field of a buffer split in place by ks::split into out. Returns the
+// index of the first bad field, or -1 if all parsed.
+template<typename T, typename OffsetT>
+inline ptrdiff_t parse_fields(const char *s, const std::vector<OffsetT> &offsets, std::vector<T> &out) {
+    out.resize(offsets.size());
+    for(size_t i = 0; i < offsets.size(); ++i)
+        if(parse(s + offsets[i], out[i]) != parse_status::ok) return i;
+    return -1;
+}
+
+struct parse_error_t {
+    size_t line;       // 0-based line index, counting empty lines.
+    unsigned column;
+    parse_status status;
+};
+
+struct parse_result_t {
+    size_t rows = 0;
+    size_t nerrors = 0;
+    std::vector<parse_error_t> errors; // The first max_errors errors.
+    bool ok() const {return nerrors == 0;}
+};
+
+namespace parse_detail {
+template<typename T>
+inline T bad_value() {
+    if constexpr(std::is_floating_point<T>::value) return std::numeric_limits<T>::quiet_NaN();
+    else return T(0);
+}
+} // namespace parse_detail
+
+// Parses buf as lines of delim-separated fields, appending field i to the i-th column.
+// Fields beyond the last column are ignored and empty lines are skipped. A field that
+// is missing or does not parse appends 0 (NaN for floating point) so the columns
+// stay aligned, and is recorded in the result; at most max_errors are kept.
+// A value which underflows appends its signed zero, and is recorded too.
+template<typename... Ts>
+parse_result_t parse_columns(const char *buf, size_t len, char delim, size_t max_errors, std::vector<Ts> &... cols) {
+    static_assert(sizeof...(Ts) > 0, "parse_columns needs at least one column.");
+    parse_result_t ret;
+    auto fail = [&](size_t line, unsigned col, parse_status st) {
+        if(ret.errors.size() < max_errors) ret.errors.push_back(parse_error_t{line, col, st});
+        ++ret.nerrors;
+    };
+    const char *p = buf, *const end = buf + len;
+    for(size_t line = 0; p < end; ++line) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        if(eol == nullptr) eol = end;
+        const char *next = eol + (eol < end);
+        if(eol > p && eol[-1] == '\r') --eol;
+        if(eol == p) {p = next; continue;}
+        unsigned col = 0;
+        const char *f = p;
+        auto parse_one = [&](auto &vec) {
+            using T = typename std::decay_t<decltype(vec)>::value_type;
+            T v;
+            if(f == nullptr) {
+                vec.push_back(parse_detail::bad_value<T>());
+                fail(line, col++, parse_status::missing);
+                return;
+            }
+            const char *fe = static_cast<const char *>(std::memchr(f, delim, eol - f));
+            if(fe == nullptr) fe = eol;
+            const parse_status st = parse(f, fe - f, v);
+            if(st == parse_status::ok) vec.push_back(v);
+            else vec.push_back(st == parse_status::underflow ? v: parse_detail::bad_value<T>()), fail(line, col, st);
+            ++col;
+            f = fe < eol ? fe + 1: nullptr;
+        };
+        (parse_one(cols), ...);
+        ++ret.rows;
+        p = next;
+    }
+    return ret;
+}
+template<typename... Ts>
+parse_result_t parse_columns(const char *buf, size_t len, char delim, std::vector<Ts> &... cols) {
+    return parse_columns(buf, len, delim, size_t(100), cols...);
+}
+
+} // namespace ks
+
+#endif
@@ -0,0 +1,72 @@
+#include "ks.h"
+#include "ksparse.h"
+#include <cinttypes>
+#include <cmath>
+#include <random>
+#include <string>
+
+int main() {
+    int rc = 0;
+    std::mt19937_64 mt(23);
+    char buf[64];
+    for(size_t i = 0; i < 200000; ++i) {
+        const int64_t x = int64_t(mt()) >> (mt() % 64);
+        const uint64_t u = mt() >> (mt() % 64);
+        int64_t xi; uint64_t ui; int32_t i32;
+        std::snprintf(buf, sizeof(buf), "%" PRId64, x);
+        if(ks::parse(buf, xi) != ks::parse_status::ok || xi != x) {rc |= std::fprintf(stderr, "int64 %s\n", buf); break;}
+        const auto st32 = ks::parse(buf, i32);
+        if(x >= INT32_MIN && x <= INT32_MAX ? (st32 != ks::parse_status::ok || i32 != x): st32 != ks::parse_status::overflow) {rc |= std::fprintf(stderr, "int32 %s\n", buf); break;}
+        std::snprintf(buf, sizeof(buf), "%" PRIu64, u);
+        if(ks::parse(buf, ui) != ks::parse_status::ok || ui != u) {rc |= std::fprintf(stderr, "uint64 %s\n", buf); break;}
+        // Doubles at several precisions, including ones which need the slow path.
+        const double d = std::ldexp(double(int64_t(mt())), -int(mt() % 100)) * ((mt() & 1) ? 1: 1e-300);
+        double dp;
+        std::snprintf(buf, sizeof(buf), (i & 1) ? "%.17g": "%.6f", d);
+        const double ref = std::strtod(buf, nullptr);
+        if(ks::parse(buf, dp) != ks::parse_status::ok || dp != ref) {rc |= std::fprintf(stderr, "double %s: %.17g vs %.17g\n", buf, dp, ref); break;}
+    }
+    int64_t x;
+    uint64_t u;
+    double d;
+    if(ks::parse("18446744073709551615", u) != ks::parse_status::ok || u != UINT64_MAX) rc |= std::fprintf(stderr, "uint64 max\n");
+    if(ks::parse("18446744073709551616", u) != ks::parse_status::overflow) rc |= std::fprintf(stderr, "uint64 overflow\n");
+    if(ks::parse("-9223372036854775808", x) != ks::parse_status::ok || x != INT64_MIN) rc |= std::fprintf(stderr, "int64 min\n");
+    if(ks::parse("00000000000000000000000042", x) != ks::parse_status::ok || x != 42) rc |= std::fprintf(stderr, "leading zeros\n");
+    for(const char *bad: {"", "-", "+", "1 ", " 1", "1x", "--1", "0x10"}) {
+        if(ks::parse(bad, x) == ks::parse_status::ok) rc |= std::fprintf(stderr, "accepted int '%s'\n", bad);
+    }
+    for(const char *bad: {"", ".", "e5", "1e", "1.5.", "+-1", "1e5 "}) {
+        if(ks::parse(bad, d) == ks::parse_status::ok) rc |= std::fprintf(stderr, "accepted double '%s'\n", bad);
+    }
+    if(ks::parse("-0.0", d) != ks::parse_status::ok || !std::signbit(d) || ks::parse("inf", d) != ks::parse_status::ok || !std::isinf(d)
+       || ks::parse("+1.5E-3", d) != ks::parse_status::ok || d != 1.5e-3 || ks::parse("1e400", d) != ks::parse_status::overflow)
+        rc |= std::fprintf(stderr, "double special values\n");
+    // Out of range toward zero is underflow, not overflow; denormals are representable.
+    if(ks::parse("1e-400", d) != ks::parse_status::underflow || d != 0 || std::signbit(d)
+       || ks::parse("-0.000001e-399", d) != ks::parse_status::underflow || d != 0 || !std::signbit(d)
+       || ks::parse("12345678901234567890123e-420", d) != ks::parse_status::underflow
+       || ks::parse("-1e400", d) != ks::parse_status::overflow || ks::parse("0.0001e400", d) != ks::parse_status::overflow
+       || ks::parse("1e-310", d) != ks::parse_status::ok || d != 1e-310)
+        rc |= std::fprintf(stderr, "double underflow\n");
+
+    ks::string line("3\t-7\t0.25\textra\n");
+    std::vector<uint64_t> offsets;
+    ks::split(line.data(), '\t', line.size(), offsets);
+    std::vector<double> fields;
+    if(ks::parse_fields(line.data(), std::vector<uint64_t>(offsets.begin(), offsets.begin() + 3), fields) != -1 || fields[1] != -7 || fields[2] != 0.25)
+        rc |= std::fprintf(stderr, "parse_fields\n");
+
+    const std::string table = "1\t2.5\t10\n\n-3\tfoo\t11\r\n4\t1e3\n5\t6\t18446744073709551616\tx\n";
+    std::vector<int32_t> a;
+    std::vector<double> b;
+    std::vector<uint64_t> c;
+    const auto res = ks::parse_columns(table.data(), table.size(), '\t', a, b, c);
+    if(res.rows != 4 || a.size() != 4 || b.size() != 4 || c.size() != 4 || a[1] != -3 || b[2] != 1000. || c[1] != 11 || !std::isnan(b[1]))
+        rc |= std::fprintf(stderr, "parse_columns values\n");
+    if(res.nerrors != 3 || res.errors[0].line != 2 || res.errors[0].column != 1 || res.errors[0].status != ks::parse_status::invalid
+       || res.errors[1].status != ks::parse_status::missing || res.errors[2].status != ks::parse_status::overflow)
+        rc |= std::fprintf(stderr, "parse_columns errors\n");
+    std::fprintf(stderr, "ksparsetest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}
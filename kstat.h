@@ -0,0 +1,156 @@
+#ifndef KSTAT_H__
+#define KSTAT_H__
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+
+/*
+ * Opt-in operation counters for ks, kmp and kb.
+ * Define KSPP_STATS=1 before including any kspp header (or pass -DKSPP_STATS=1)
+ * to enable them; otherwise KSTAT_ADD compiles to nothing and snapshots are zero.
+ * Counters are thread-local; snapshot() reads the calling thread's counters and
+ * snapshot_all() sums every live thread plus those which have exited.
+ */
+
+#ifndef KSPP_STATS
+#define KSPP_STATS 0
+#endif
+
+#if KSPP_STATS
+#include <atomic>
+#include <mutex>
+#include <vector>
+#endif
+
+// X(name, description)
+#define KSTAT_FIELDS(X) \
+    X(string_reallocs,     "ks::string reallocations") \
+    X(string_growth_bytes, "bytes of capacity added by reallocation") \
+    X(string_copy_bytes,   "live bytes realloc may have copied") \
+    X(pool_hits,           "kmp pool allocations served from freed blocks") \
+    X(pool_misses,         "kmp pool allocations requiring fresh memory") \
+    X(pool_slabs,          "kmp::SlabPool slabs allocated") \
+    X(kb_puts,             "kb insertions") \
+    X(kb_put_depth,        "total nodes visited by kb insertions") \
+    X(kb_splits,           "kb node splits") \
+    X(kb_lookups,          "kb lookups") \
+    X(kb_comparisons,      "key comparisons in kb node searches") \
+    X(search_calls,        "ks::string substring searches") \
+    X(search_bytes,        "bytes of text covered by substring searches")
+
+namespace kstat {
+
+struct counters_t {
+#define KSTAT_DECLARE(name, desc) uint64_t name = 0;
+    KSTAT_FIELDS(KSTAT_DECLARE)
+#undef KSTAT_DECLARE
+    counters_t &operator+=(const counters_t &o) {
+#define KSTAT_ADD_FIELD(name, desc) name += o.name;
+        KSTAT_FIELDS(KSTAT_ADD_FIELD)
+#undef KSTAT_ADD_FIELD
+        return *this;
+    }
+    counters_t operator-(const counters_t &o) const {
+        counters_t ret;
+#define KSTAT_SUB_FIELD(name, desc) ret.name = name - o.name;
+        KSTAT_FIELDS(KSTAT_SUB_FIELD)
+#undef KSTAT_SUB_FIELD
+        return ret;
+    }
+    // Writes one "name\tvalue\tdescription" line per counter, prefixed by label if given.
+    int dump(std::FILE *fp=stderr, const char *label=nullptr) const {
+        int ret = 0;
+#define KSTAT_DUMP_FIELD(name, desc) \
+        ret += std::fprintf(fp, "%s%s%s\t%" PRIu64 "\t%s\n", label ? label: "", label ? ":": "", #name, name, desc);
+        KSTAT_FIELDS(KSTAT_DUMP_FIELD)
+#undef KSTAT_DUMP_FIELD
+        return ret;
+    }
+};
+
+static constexpr bool enabled = KSPP_STATS;
+
+#if KSPP_STATS
+namespace detail {
+struct thread_counters_t;
+struct registry_t {
+    std::mutex m;
+    std::vector<const thread_counters_t *> live;
+    counters_t exited;
+};
+inline registry_t &registry() {
+    static registry_t ret;
+    return ret;
+}
+struct thread_counters_t {
+    // Written only by the owning thread; relaxed atomics make cross-thread snapshots well-defined.
+#define KSTAT_DECLARE(name, desc) std::atomic<uint64_t> name{0};
+    KSTAT_FIELDS(KSTAT_DECLARE)
+#undef KSTAT_DECLARE
+    registry_t &registry_;
+    thread_counters_t(): registry_(registry()) {
+        std::lock_guard<std::mutex> lock(registry_.m);
+        registry_.live.push_back(this);
+    }
+    counters_t load() const {
+        counters_t ret;
+#define KSTAT_LOAD_FIELD(name, desc) ret.name = name.load(std::memory_order_relaxed);
+        KSTAT_FIELDS(KSTAT_LOAD_FIELD)
+#undef KSTAT_LOAD_FIELD
+        return ret;
+    }
+    void reset() {
+#define KSTAT_RESET_FIELD(name, desc) name.store(0, std::memory_order_relaxed);
+        KSTAT_FIELDS(KSTAT_RESET_FIELD)
+#undef KSTAT_RESET_FIELD
+    }
+    ~thread_counters_t() {
+        std::lock_guard<std::mutex> lock(registry_.m);
+        registry_.exited += load();
+        for(auto &p: registry_.live) if(p == this) {p = registry_.live.back(); break;}
+        registry_.live.pop_back();
+    }
+};
+inline thread_counters_t &local() {
+    static thread_local thread_counters_t ret;
+    return ret;
+}
+} // namespace detail
+
+#define KSTAT_ADD(field, n) do {\
+        auto &kstat_c_ = ::kstat::detail::local().field;\
+        kstat_c_.store(kstat_c_.load(std::memory_order_relaxed) + (n), std::memory_order_relaxed);\
+    } while(0)
+
+inline counters_t snapshot() {return detail::local().load();}
+inline counters_t snapshot_all() {
+    auto &reg = detail::registry();
+    std::lock_guard<std::mutex> lock(reg.m);
+    counters_t ret = reg.exited;
+    for(const auto p: reg.live) ret += p->load();
+    return ret;
+}
+inline void reset() {detail::local().reset();}
+#else
+#define KSTAT_ADD(field, n) do {} while(0)
+inline counters_t snapshot()     {return counters_t();}
+inline counters_t snapshot_all() {return counters_t();}
+inline void reset() {}
+#endif
+
+inline int dump(std::FILE *fp=stderr) {return snapshot().dump(fp);}
+
+// Dumps the calling thread's counter deltas over the lifetime of the scope.
+class Scope {
+    const char *label_;
+    std::FILE *fp_;
+    counters_t start_;
+public:
+    Scope(const char *label, std::FILE *fp=stderr): label_(label), fp_(fp), start_(snapshot()) {}
+    counters_t elapsed() const {return snapshot() - start_;}
+    ~Scope() {if(enabled) elapsed().dump(fp_, label_);}
+};
+
+} // namespace kstat
+
+#endif
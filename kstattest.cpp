@@ -0,0 +1,32 @@
+#define KSPP_STATS 1
+#include "ks.h"
+#include "kb.h"
+#include <thread>
+
+int main() {
+    int rc = 0;
+    {
+        kstat::Scope scope("kstattest");
+        ks::string s;
+        for(int i = 0; i < 1000; ++i) s.putc('a');
+        s.locate("b");
+        kb::KBTree<uint64_t> tree;
+        for(uint64_t i = 0; i < 10000; ++i) tree.put(i);
+        tree.get(uint64_t(5000));
+        const auto c = scope.elapsed();
+        const auto pool_start = kstat::snapshot();
+        kmp::Pool<int> pool;
+        pool.free(pool.malloc());
+        pool.free(pool.malloc());
+        const auto p = kstat::snapshot() - pool_start;
+        if(c.string_reallocs == 0 || c.string_reallocs > 16) rc |= std::fprintf(stderr, "unexpected reallocs %zu\n", size_t(c.string_reallocs));
+        if(c.search_calls != 1 || c.search_bytes != 1000) rc |= std::fprintf(stderr, "unexpected search counters\n");
+        if(c.kb_puts != 10000 || c.kb_splits == 0 || c.kb_lookups != 1 || c.kb_comparisons == 0) rc |= std::fprintf(stderr, "unexpected kb counters\n");
+        if(p.pool_hits != 1 || p.pool_misses != 1) rc |= std::fprintf(stderr, "unexpected pool counters\n");
+    }
+    const auto before = kstat::snapshot_all();
+    std::thread([] {ks::string s; s.resize(1 << 20);}).join();
+    if((kstat::snapshot_all() - before).string_reallocs != 1) rc |= std::fprintf(stderr, "exited thread counters were lost\n");
+    std::fprintf(stderr, "kstattest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}
@@ -0,0 +1,51 @@
+#include "ks.h"
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+
+static int sign(int x) {return (x > 0) - (x < 0);}
+
+int main() {
+    int rc = 0;
+    std::mt19937_64 mt(29);
+    // Every length across the overlapping-load and vector paths, with the mismatch at each
+    // position. Operands are exact-size heap copies so that any overread is caught by ASan.
+    for(size_t len = 0; len < 150; ++len) {
+        for(size_t pos = 0; pos <= len; ++pos) {
+            std::string a(len, '\0');
+            for(auto &c: a) c = char(mt() % 4 ? mt(): 0); // Embedded NULs and bytes >= 0x80.
+            std::string b = a;
+            if(pos < len) b[pos] = char(b[pos] ^ (1 + mt() % 255));
+            std::unique_ptr<char[]> pa(new char[len]), pb(new char[len]);
+            std::memcpy(pa.get(), a.data(), len); std::memcpy(pb.get(), b.data(), len);
+            if(ks::common_prefix_len(pa.get(), pb.get(), len) != pos) rc |= std::fprintf(stderr, "common_prefix_len mismatch: len %zu pos %zu\n", len, pos);
+            if(ks::bytes_equal(pa.get(), pb.get(), len) != (pos == len)) rc |= std::fprintf(stderr, "bytes_equal mismatch: len %zu pos %zu\n", len, pos);
+            if(sign(ks::bytes_compare(pa.get(), len, pb.get(), len)) != sign(std::string_view(a).compare(b)))
+                rc |= std::fprintf(stderr, "bytes_compare mismatch: len %zu pos %zu\n", len, pos);
+            // A proper prefix sorts first.
+            if(len && (ks::bytes_compare(pa.get(), len - 1, pb.get(), len) >= 0) != (pos < len - 1 && std::string_view(a).substr(0, len - 1) > std::string_view(b)))
+                rc |= std::fprintf(stderr, "bytes_compare prefix mismatch: len %zu pos %zu\n", len, pos);
+        }
+    }
+
+    // Embedded NULs take part in comparison; strcmp would stop at them.
+    const ks::string x(std::string("ab\0c", 4)), y(std::string("ab\0d", 4)), z(std::string("ab", 2));
+    if(x.cmp(y) >= 0 || y.cmp(x) <= 0 || x.cmp(x) != 0) rc |= std::fprintf(stderr, "cmp ignores embedded NUL\n");
+    if(!(z < x) || !(x < y) || !(y > z) || !(x <= x) || x == y) rc |= std::fprintf(stderr, "relational operator mismatch\n");
+    if(x.cmp("ab") <= 0 || z.cmp("ab") != 0 || z.cmp("abc") >= 0) rc |= std::fprintf(stderr, "cmp(const char *) mismatch\n");
+    if(x.common_prefix_len(y) != 3 || z.common_prefix_len(std::string("abc")) != 2) rc |= std::fprintf(stderr, "member common_prefix_len mismatch\n");
+    if(x == "ab" || !(z == "ab") || z == "abc" || z == "a" || z == nullptr) rc |= std::fprintf(stderr, "operator==(const char *) mismatch\n");
+    if(!(ks::string() == "") || ks::string() != "") rc |= std::fprintf(stderr, "empty operator== mismatch\n");
+
+    // Prefix and suffix checks never read outside the string.
+    const ks::string w("abcdef");
+    if(!w.startswith("abc") || !w.startswith("abcdef") || w.startswith("abcdefg") || w.startswith("abd") || !w.startswith(""))
+        rc |= std::fprintf(stderr, "startswith mismatch\n");
+    if(!w.endswith("def") || !w.endswith("abcdef") || w.endswith("zabcdef") || w.endswith("dee") || !w.endswith(""))
+        rc |= std::fprintf(stderr, "endswith mismatch\n");
+    if(!w.bmcontains("cde") || w.bmcontains("cdf") || w.bmcontains("abcdefg")) rc |= std::fprintf(stderr, "bmcontains mismatch\n");
+
+    std::fprintf(stderr, "kstest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}
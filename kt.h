@@ -0,0 +1,317 @@
+#ifndef KT_H__
+#define KT_H__
+#include "ks.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+ * A reader -> workers -> ordered writer pipeline for line-oriented input.
+ *
+ * The reader thread fills blocks of about block_bytes, cut after the last complete
+ * line, and deals them round-robin to per-worker deques. Idle workers take from
+ * the front of their own deque and steal from the back of the others. Each block
+ * owns an input and an output ks::string which are recycled, so steady state
+ * allocates nothing. The writer, on the calling thread, emits outputs in input order.
+ * The number of blocks in flight is fixed, which bounds memory and blocks the
+ * reader when workers or the writer fall behind.
+ *
+ * An exception thrown by the source, a worker or the sink stops the pipeline
+ * and is rethrown from run_pipeline once every thread has finished.
+ */
+
+namespace kt {
+
+// Blocking FIFO with a fixed capacity.
+template<typename T>
+class BoundedQueue {
+    std::mutex m_;
+    std::condition_variable not_empty_, not_full_;
+    std::deque<T> q_;
+    size_t cap_;
+    bool closed_;
+public:
+    explicit BoundedQueue(size_t cap): cap_(std::max<size_t>(cap, 1)), closed_(false) {}
+    // Blocks while full. Returns false if the queue has been closed.
+    bool push(T x) {
+        std::unique_lock<std::mutex> lock(m_);
+        not_full_.wait(lock, [this] {return q_.size() < cap_ || closed_;});
+        if(closed_) return false;
+        q_.push_back(std::move(x));
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+    // Blocks while empty. Returns false once the queue is closed and drained.
+    bool pop(T &x) {
+        std::unique_lock<std::mutex> lock(m_);
+        not_empty_.wait(lock, [this] {return !q_.empty() || closed_;});
+        if(q_.empty()) return false;
+        x = std::move(q_.front());
+        q_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+};
+
+struct pipeline_opts_t {
+    unsigned nworkers = 0;           // 0 uses every hardware thread.
+    size_t block_bytes = 1 << 22;    // Target input block size; a longer line makes a larger block.
+    unsigned blocks_per_worker = 4;  // Blocks in flight per worker, bounding memory to about this many blocks each.
+};
+
+namespace detail {
+
+struct block_t {
+    size_t seq;
+    ks::string in, out;
+};
+
+// source(char *buf, size_t n) returns the number of bytes read, 0 at EOF or < 0 on error.
+// work(ks::string &in, ks::string &out) turns whole lines into output; in may be modified (e.g. by ks::split).
+// sink(const ks::string &out) consumes outputs in input order.
+template<typename Source, typename Work, typename Sink>
+class Pipeline {
+    struct alignas(64) worker_queue_t {
+        std::mutex m;
+        std::deque<block_t *> q;
+    };
+
+    Source &source_;
+    Work &work_;
+    Sink &sink_;
+    const pipeline_opts_t opts_;
+    const unsigned nworkers_;
+    const size_t nblocks_;
+    std::unique_ptr<block_t[]> blocks_;
+    BoundedQueue<block_t *> free_;
+    std::unique_ptr<worker_queue_t[]> queues_;
+
+    // Dispatch: pending_ counts queued blocks; changes which may wake a worker are made under sleep_m_.
+    std::mutex sleep_m_;
+    std::condition_variable sleep_cv_;
+    std::atomic<int64_t> pending_;
+    bool input_done_;
+
+    // Completion: done_[seq % nblocks_] holds a finished block until the writer reaches it.
+    std::mutex done_m_;
+    std::condition_variable done_cv_;
+    std::vector<block_t *> done_;
+    size_t total_blocks_;
+    bool reader_finished_;
+
+    std::atomic<bool> aborted_;
+    std::mutex error_m_;
+    std::exception_ptr error_;
+
+    void fail() {
+        std::lock_guard<std::mutex> lock(error_m_);
+        if(!error_) error_ = std::current_exception();
+        aborted_.store(true, std::memory_order_relaxed);
+    }
+
+    void dispatch(block_t *b) {
+        worker_queue_t &wq = queues_[b->seq % nworkers_];
+        {
+            std::lock_guard<std::mutex> lock(wq.m);
+            wq.q.push_back(b);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_m_);
+            ++pending_;
+        }
+        sleep_cv_.notify_one();
+    }
+    bool take(unsigned id, block_t *&b) {
+        for(unsigned i = 0; i < nworkers_; ++i) {
+            worker_queue_t &wq = queues_[(id + i) % nworkers_];
+            std::lock_guard<std::mutex> lock(wq.m);
+            if(wq.q.empty()) continue;
+            // Own work from the front (oldest first), stolen work from the back.
+            if(i == 0) b = wq.q.front(), wq.q.pop_front();
+            else       b = wq.q.back(),  wq.q.pop_back();
+            --pending_;
+            return true;
+        }
+        return false;
+    }
+    bool next_task(unsigned id, block_t *&b) {
+        for(;;) {
+            if(take(id, b)) return true;
+            std::unique_lock<std::mutex> lock(sleep_m_);
+            sleep_cv_.wait(lock, [this] {return pending_ > 0 || input_done_;});
+            if(pending_ <= 0 && input_done_) return false;
+        }
+    }
+    void complete(block_t *b) {
+        {
+            std::lock_guard<std::mutex> lock(done_m_);
+            done_[b->seq % nblocks_] = b;
+        }
+        done_cv_.notify_one();
+    }
+
+    void read_all() {
+        size_t seq = 0;
+        try {
+            ks::string carry;
+            const size_t block_bytes = std::max<size_t>(opts_.block_bytes, 1);
+            for(bool eof = false; !eof && !aborted_.load(std::memory_order_relaxed);) {
+                block_t *b;
+                if(!free_.pop(b)) break;
+                ks::string &in = b->in;
+                in.clear();
+                in.append(carry.data(), carry.size());
+                carry.clear();
+                size_t scan_from = in.size(); // The carried partial line holds no newline.
+                for(;;) {
+                    if(in.size() >= block_bytes) {
+                        size_t cut = in.size();
+                        while(cut > scan_from && in[cut - 1] != '\n') --cut;
+                        if(cut > scan_from) {
+                            carry.append(in.data() + cut, in.size() - cut);
+                            in.set_size(cut);
+                            break;
+                        }
+                        scan_from = in.size();
+                    }
+                    const size_t want = std::max(block_bytes, in.size() + std::max<size_t>(block_bytes / 2, 4096));
+                    in.resize(want + 1);
+                    const auto r = source_(in.data() + in.size(), want - in.size());
+                    if(r < 0) throw std::runtime_error("kt pipeline source failed.");
+                    if(r == 0) {eof = true; break;}
+                    in.set_size(in.size() + size_t(r));
+                }
+                in.terminate();
+                if(in.size() == 0) {free_.push(b); break;}
+                b->seq = seq++;
+                dispatch(b);
+            }
+        } catch(...) {
+            fail();
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_m_);
+            input_done_ = true;
+        }
+        sleep_cv_.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(done_m_);
+            total_blocks_ = seq;
+            reader_finished_ = true;
+        }
+        done_cv_.notify_one();
+    }
+
+    void work(unsigned id) {
+        block_t *b;
+        while(next_task(id, b)) {
+            b->out.clear();
+            if(!aborted_.load(std::memory_order_relaxed)) {
+                try {
+                    work_(b->in, b->out);
+                } catch(...) {
+                    fail();
+                }
+            }
+            complete(b);
+        }
+    }
+
+    void write_all() {
+        for(size_t next = 0;; ++next) {
+            block_t *b;
+            {
+                std::unique_lock<std::mutex> lock(done_m_);
+                done_cv_.wait(lock, [&] {return done_[next % nblocks_] != nullptr || (reader_finished_ && next == total_blocks_);});
+                if((b = done_[next % nblocks_]) == nullptr) return;
+                done_[next % nblocks_] = nullptr;
+            }
+            if(!aborted_.load(std::memory_order_relaxed)) {
+                try {
+                    sink_(static_cast<const ks::string &>(b->out));
+                } catch(...) {
+                    fail();
+                }
+            }
+            free_.push(b);
+        }
+    }
+
+public:
+    Pipeline(Source &source, Work &work, Sink &sink, const pipeline_opts_t &opts):
+        source_(source), work_(work), sink_(sink), opts_(opts),
+        nworkers_(opts.nworkers ? opts.nworkers: std::max(1u, std::thread::hardware_concurrency())),
+        nblocks_(size_t(nworkers_) * std::max(opts.blocks_per_worker, 1u) + 2),
+        blocks_(new block_t[nblocks_]), free_(nblocks_), queues_(new worker_queue_t[nworkers_]),
+        pending_(0), input_done_(false), done_(nblocks_, nullptr), total_blocks_(0), reader_finished_(false), aborted_(false)
+    {
+        for(size_t i = 0; i < nblocks_; ++i) free_.push(&blocks_[i]);
+    }
+
+    size_t run() {
+        std::thread reader(&Pipeline::read_all, this);
+        std::vector<std::thread> workers;
+        for(unsigned i = 0; i < nworkers_; ++i) workers.emplace_back(&Pipeline::work, this, i);
+        write_all();
+        reader.join();
+        for(auto &t: workers) t.join();
+        if(error_) std::rethrow_exception(error_);
+        return total_blocks_;
+    }
+};
+
+} // namespace detail
+
+// Runs the pipeline to completion and returns the number of blocks processed.
+// See detail::Pipeline for the signatures of source, work and sink.
+template<typename Source, typename Work, typename Sink>
+size_t run_pipeline(Source &&source, Work &&work, Sink &&sink, const pipeline_opts_t &opts=pipeline_opts_t()) {
+    return detail::Pipeline<std::remove_reference_t<Source>, std::remove_reference_t<Work>, std::remove_reference_t<Sink>>(source, work, sink, opts).run();
+}
+
+inline auto file_source(std::FILE *fp) {
+    return [fp](char *buf, size_t n) -> ptrdiff_t {
+        const size_t r = std::fread(buf, 1, n, fp);
+        return r == 0 && std::ferror(fp) ? -1: ptrdiff_t(r);
+    };
+}
+inline auto gz_source(gzFile fp) {
+    return [fp](char *buf, size_t n) -> ptrdiff_t {
+        return gzread(fp, buf, unsigned(std::min<size_t>(n, 1u << 30)));
+    };
+}
+inline auto file_sink(std::FILE *fp) {
+    return [fp](const ks::string &out) {
+        if(out.size() && out.write(fp) != out.size()) throw std::runtime_error("kt pipeline sink failed.");
+    };
+}
+
+// Reads lines from in, transforms each block with work and writes the results to out in order.
+template<typename Work>
+size_t process_lines(std::FILE *in, std::FILE *out, Work &&work, const pipeline_opts_t &opts=pipeline_opts_t()) {
+    return run_pipeline(file_source(in), std::forward<Work>(work), file_sink(out), opts);
+}
+
+} // namespace kt
+
+#endif
@@ -0,0 +1,80 @@
+#include "kt.h"
+#include "ksparse.h"
+#include <random>
+#include <string>
+
+int main() {
+    int rc = 0;
+    std::mt19937_64 mt(29);
+    // Lines of integers, some much longer than a block, and no trailing newline.
+    std::string input, expected;
+    for(size_t i = 0; i < 20000; ++i) {
+        const size_t nfields = (i % 997 == 0) ? 400: 1 + mt() % 8;
+        int64_t sum = 0;
+        for(size_t j = 0; j < nfields; ++j) {
+            const int64_t x = int64_t(mt() % 2000001) - 1000000;
+            input += (j ? "\t": "") + std::to_string(x);
+            sum += x;
+        }
+        input += '\n';
+        expected += std::to_string(sum) + '\n';
+    }
+    input.pop_back();
+    // Sums each line's fields.
+    auto work = [](ks::string &in, ks::string &out) {
+        std::vector<uint64_t> offsets;
+        for(char *line = in.data(), *end = in.data() + in.size(); line < end;) {
+            char *eol = static_cast<char *>(std::memchr(line, '\n', end - line));
+            if(eol == nullptr) eol = end;
+            *eol = 0;
+            offsets.clear();
+            ks::split(line, '\t', eol - line, offsets);
+            int64_t sum = 0, x;
+            for(const auto off: offsets) {
+                if(ks::parse(line + off, x) != ks::parse_status::ok) throw std::runtime_error("bad field");
+                sum += x;
+            }
+            out.putl(sum);
+            out.putc('\n');
+            line = eol + 1;
+        }
+    };
+    for(const size_t block_bytes: {size_t(64), size_t(4096), size_t(1) << 20}) {
+        for(const unsigned nworkers: {1u, 4u}) {
+            size_t pos = 0;
+            auto source = [&](char *buf, size_t n) -> ptrdiff_t {
+                n = std::min(n, std::min(input.size() - pos, size_t(1000)));
+                std::memcpy(buf, input.data() + pos, n);
+                pos += n;
+                return n;
+            };
+            std::string output;
+            kt::pipeline_opts_t opts;
+            opts.nworkers = nworkers;
+            opts.block_bytes = block_bytes;
+            opts.blocks_per_worker = 2;
+            kt::run_pipeline(source, work, [&](const ks::string &out) {output.append(out.data(), out.size());}, opts);
+            if(output != expected) rc |= std::fprintf(stderr, "output mismatch with block_bytes=%zu nworkers=%u\n", block_bytes, nworkers);
+        }
+    }
+    // A throwing worker stops the pipeline and the exception reaches the caller.
+    const std::string bad = input.substr(0, 100000) + "\n1\tx\n" + input.substr(0, 100000);
+    size_t pos = 0;
+    bool caught = false;
+    try {
+        kt::pipeline_opts_t opts;
+        opts.nworkers = 3;
+        opts.block_bytes = 1024;
+        kt::run_pipeline([&](char *buf, size_t n) -> ptrdiff_t {
+            n = std::min(n, bad.size() - pos);
+            std::memcpy(buf, bad.data() + pos, n);
+            pos += n;
+            return n;
+        }, work, [](const ks::string &) {}, opts);
+    } catch(const std::runtime_error &e) {
+        caught = std::strcmp(e.what(), "bad field") == 0;
+    }
+    if(!caught) rc |= std::fprintf(stderr, "worker exception was not propagated\n");
+    std::fprintf(stderr, "kttest: %s\n", rc ? "failed": "passed");
+    return rc != 0;
+}